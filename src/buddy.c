@@ -0,0 +1,246 @@
+#define _GNU_SOURCE
+#include "memory_internal.h"
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ * Binary buddy allocator (ALGO_BUDDY). On first use a heap takes one
+ * 2^buddy_order byte block from its own block list and carves it into
+ * power-of-two blocks between 2^buddy_min_order and the whole region. A
+ * block's buddy is found by XOR-ing its region offset with its size. Each
+ * buddy pair has one bit that is set while exactly one of the two sits on
+ * a free list (toggled on every push and pop), so a free() knows whether
+ * it can merge without looking at the buddy. orders[] records the order of
+ * each allocated block by its first minimum-size unit.
+ */
+
+#define BUDDY_DEFAULT_ORDER 20    /* 1 MB region */
+#define BUDDY_DEFAULT_MIN_ORDER 4 /* 16 bytes, room for the free-list links */
+#define BUDDY_MAX_ORDER 40
+#define BUDDY_NOT_ALLOCATED 0xFF
+
+/* Stored in a free block */
+typedef struct buddy_node
+{
+    struct buddy_node *next;
+    struct buddy_node *prev;
+} buddy_node_t;
+
+struct mf_buddy
+{
+    char *base;                               /* Region payload inside the heap */
+    unsigned order;                           /* Region is 2^order bytes */
+    unsigned min_order;                       /* Smallest block */
+    uint64_t nonempty;                        /* Bit k set while free[k] has blocks */
+    buddy_node_t *free[BUDDY_MAX_ORDER + 1];  /* Free lists per order */
+    size_t pair_base[BUDDY_MAX_ORDER + 1];    /* First bit of each order in pairs */
+    size_t free_bytes;                        /* Sum over the free lists */
+    size_t map_size;                          /* Bytes of this mapping */
+    uint64_t *pairs;                          /* Buddy-pair bits, after this struct */
+    uint8_t *orders;                          /* Per minimum unit, after pairs */
+};
+
+int heap_set_buddy(memflex_heap_t *heap, unsigned order, unsigned min_order)
+{
+    if (!heap || heap->magic != HEAP_MAGIC || heap->buddy)
+        return -1;
+    if (min_order < BUDDY_DEFAULT_MIN_ORDER || order <= min_order || order > BUDDY_MAX_ORDER)
+        return -1;
+
+    heap->buddy_order = order;
+    heap->buddy_min_order = min_order;
+    return 0;
+}
+
+static void toggle_pair(struct mf_buddy *b, size_t off, unsigned k)
+{
+    if (k == b->order)
+        return; // The whole region has no buddy
+    size_t bit = b->pair_base[k] + (off >> (k + 1));
+    b->pairs[bit / 64] ^= 1ull << (bit % 64);
+}
+
+static int pair_bit(struct mf_buddy *b, size_t off, unsigned k)
+{
+    size_t bit = b->pair_base[k] + (off >> (k + 1));
+    return (int)((b->pairs[bit / 64] >> (bit % 64)) & 1);
+}
+
+static void push(struct mf_buddy *b, size_t off, unsigned k)
+{
+    buddy_node_t *node = (buddy_node_t *)(b->base + off);
+    node->next = b->free[k];
+    node->prev = NULL;
+    if (node->next)
+        node->next->prev = node;
+    b->free[k] = node;
+    b->nonempty |= 1ull << k;
+    b->free_bytes += (size_t)1 << k;
+    toggle_pair(b, off, k);
+}
+
+static void unlink_node(struct mf_buddy *b, buddy_node_t *node, unsigned k)
+{
+    if (node->next)
+        node->next->prev = node->prev;
+    if (node->prev)
+        node->prev->next = node->next;
+    else
+        b->free[k] = node->next;
+    if (!b->free[k])
+        b->nonempty &= ~(1ull << k);
+    b->free_bytes -= (size_t)1 << k;
+    toggle_pair(b, (size_t)((char *)node - b->base), k);
+}
+
+size_t mf_buddy_region_size(memflex_heap_t *heap)
+{
+    return (size_t)1 << (heap->buddy_order ? heap->buddy_order : BUDDY_DEFAULT_ORDER);
+}
+
+int mf_buddy_init(memflex_heap_t *heap, void *region)
+{
+    unsigned order = heap->buddy_order ? heap->buddy_order : BUDDY_DEFAULT_ORDER;
+    unsigned min_order = heap->buddy_min_order ? heap->buddy_min_order : BUDDY_DEFAULT_MIN_ORDER;
+
+    // pairs: 2^(order - min_order) - 1 bits in all; orders: one byte per minimum unit
+    size_t units = (size_t)1 << (order - min_order);
+    size_t pair_words = (units + 63) / 64;
+    size_t map_size = mf_page_align(sizeof(struct mf_buddy) + pair_words * sizeof(uint64_t) + units);
+    struct mf_buddy *b = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b == MAP_FAILED)
+        return -1;
+
+    b->base = region;
+    b->order = order;
+    b->min_order = min_order;
+    b->map_size = map_size;
+    b->pairs = (uint64_t *)(b + 1);
+    b->orders = (uint8_t *)(b->pairs + pair_words);
+    memset(b->orders, BUDDY_NOT_ALLOCATED, units);
+
+    size_t bit = 0;
+    for (unsigned k = order; k-- > min_order;)
+    {
+        b->pair_base[k] = bit;
+        bit += (size_t)1 << (order - k - 1);
+    }
+
+    heap->buddy = b;
+    push(b, 0, order);
+    return 0;
+}
+
+void *mf_buddy_malloc(memflex_heap_t *heap, size_t size)
+{
+    if (size == 0)
+        return NULL;
+
+    struct mf_buddy *b = heap->buddy;
+    unsigned k = b->min_order;
+    if (size > ((size_t)1 << k))
+        k = 64 - (unsigned)__builtin_clzll(size - 1);
+    if (k > b->order)
+        return NULL;
+
+    // Smallest non-empty order at or above k
+    uint64_t avail = b->nonempty & (~0ull << k);
+    if (!avail)
+        return NULL;
+    unsigned j = (unsigned)__builtin_ctzll(avail);
+
+    buddy_node_t *node = b->free[j];
+    size_t off = (size_t)((char *)node - b->base);
+    unlink_node(b, node, j);
+
+    // Keep the lower half, put the upper halves on their lists
+    while (j > k)
+    {
+        j--;
+        push(b, off + ((size_t)1 << j), j);
+    }
+
+    b->orders[off >> b->min_order] = (uint8_t)k;
+    return b->base + off;
+}
+
+/* Order of the allocated block at ptr, or -1 if ptr is not one */
+static int block_order(struct mf_buddy *b, void *ptr)
+{
+    if (!b || (char *)ptr < b->base || (char *)ptr >= b->base + ((size_t)1 << b->order))
+        return -1;
+    size_t off = (size_t)((char *)ptr - b->base);
+    if (off & (((size_t)1 << b->min_order) - 1))
+        return -1;
+    uint8_t k = b->orders[off >> b->min_order];
+    return k == BUDDY_NOT_ALLOCATED ? -1 : k;
+}
+
+int mf_buddy_owns(memflex_heap_t *heap, void *ptr)
+{
+    struct mf_buddy *b = heap->buddy;
+    return b && (char *)ptr >= b->base && (char *)ptr < b->base + ((size_t)1 << b->order);
+}
+
+void mf_buddy_free(memflex_heap_t *heap, void *ptr)
+{
+    struct mf_buddy *b = heap->buddy;
+    int order = block_order(b, ptr);
+    if (order < 0)
+        return;
+
+    unsigned k = (unsigned)order;
+    size_t off = (size_t)((char *)ptr - b->base);
+    b->orders[off >> b->min_order] = BUDDY_NOT_ALLOCATED;
+
+    // A set pair bit means the buddy is a whole free block of this order
+    while (k < b->order && pair_bit(b, off, k))
+    {
+        size_t buddy = off ^ ((size_t)1 << k);
+        unlink_node(b, (buddy_node_t *)(b->base + buddy), k);
+        off &= ~((size_t)1 << k);
+        k++;
+    }
+    push(b, off, k);
+}
+
+void *mf_buddy_realloc(memflex_heap_t *heap, void *ptr, size_t size)
+{
+    int order = block_order(heap->buddy, ptr);
+    if (order < 0)
+        return NULL;
+
+    size_t have = (size_t)1 << order;
+    if (size <= have)
+        return ptr;
+
+    void *new_ptr = mf_buddy_malloc(heap, size);
+    if (new_ptr)
+    {
+        memcpy(new_ptr, ptr, have);
+        mf_buddy_free(heap, ptr);
+    }
+    return new_ptr;
+}
+
+size_t mf_buddy_usable_size(memflex_heap_t *heap, void *ptr)
+{
+    int order = block_order(heap->buddy, ptr);
+    return order < 0 ? 0 : (size_t)1 << order;
+}
+
+size_t mf_buddy_free_bytes(memflex_heap_t *heap, size_t *largest)
+{
+    struct mf_buddy *b = heap->buddy;
+    if (largest)
+        *largest = (b && b->nonempty) ? (size_t)1 << (63 - __builtin_clzll(b->nonempty)) : 0;
+    return b ? b->free_bytes : 0;
+}
+
+void mf_buddy_release(memflex_heap_t *heap)
+{
+    // The region itself is a block of the heap and goes with it
+    if (heap->buddy)
+        munmap(heap->buddy, heap->buddy->map_size);
+    heap->buddy = NULL;
+}
@@ -0,0 +1,344 @@
+#define _GNU_SOURCE
+#include "memory_internal.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define HANDLE_TABLE_MIN 64
+
+static int grow_handles(memflex_heap_t *heap)
+{
+    uint32_t new_cap = heap->handle_cap ? heap->handle_cap * 2 : HANDLE_TABLE_MIN;
+    size_t old_bytes = (size_t)heap->handle_cap * sizeof(handle_entry_t);
+    size_t new_bytes = (size_t)new_cap * sizeof(handle_entry_t);
+    handle_entry_t *table;
+
+    if (heap->handles)
+        table = mremap(heap->handles, old_bytes, new_bytes, MREMAP_MAYMOVE);
+    else
+        table = mmap(NULL, new_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED)
+        return -1;
+
+    // Chain the new slots into the free list (slot 0 stays reserved as "no handle")
+    uint32_t first = heap->handle_cap ? heap->handle_cap : 1;
+    for (uint32_t i = first; i < new_cap; i++)
+    {
+        table[i].block = NULL;
+        table[i].pins = (i + 1 < new_cap) ? i + 1 : heap->handle_free;
+    }
+
+    heap->handles = table;
+    heap->handle_cap = new_cap;
+    heap->handle_free = first;
+    return 0;
+}
+
+void mf_release_handles(memflex_heap_t *heap)
+{
+    if (heap->handles)
+        munmap(heap->handles, (size_t)heap->handle_cap * sizeof(handle_entry_t));
+    heap->handles = NULL;
+    heap->handle_cap = 0;
+    heap->handle_free = 0;
+    heap->compact_cursor = NULL;
+}
+
+static handle_entry_t *lookup(memflex_heap_t *heap, memflex_handle_t handle)
+{
+    if (!heap || heap->magic != HEAP_MAGIC || handle == 0 || handle >= heap->handle_cap)
+        return NULL;
+    handle_entry_t *entry = &heap->handles[handle];
+    return entry->block ? entry : NULL;
+}
+
+memflex_handle_t heap_halloc(memflex_heap_t *heap, size_t size)
+{
+    // The handle table is process-local, so shared heaps have no relocatable blocks;
+    // metadata-separated heaps have no header to record the owning handle in
+    if (!heap || heap->magic != HEAP_MAGIC || heap->backing == HEAP_BACKING_SHARED ||
+        (heap->flags & HEAP_FLAG_OOB_META))
+        return 0;
+    if (heap->handle_free == 0 && grow_handles(heap) != 0)
+        return 0;
+
+    // First-fit keeps live data low in the heap, which leaves less for compaction to move
+    void *ptr = heap_malloc(heap, size, ALGO_FIRST_FIT);
+    if (!ptr)
+        return 0;
+
+    memflex_handle_t handle = heap->handle_free;
+    handle_entry_t *entry = &heap->handles[handle];
+    heap->handle_free = entry->pins;
+
+    entry->block = PAYLOAD_BLOCK(ptr);
+    entry->pins = 0;
+    entry->block->slot = handle;
+    return handle;
+}
+
+void heap_hfree(memflex_heap_t *heap, memflex_handle_t handle)
+{
+    handle_entry_t *entry = lookup(heap, handle);
+    if (!entry)
+        return;
+
+    block_header_t *block = entry->block;
+    block->slot = 0;
+    heap_free(heap, BLOCK_PAYLOAD(block));
+
+    entry->block = NULL;
+    entry->pins = heap->handle_free;
+    heap->handle_free = handle;
+}
+
+void *heap_pin(memflex_heap_t *heap, memflex_handle_t handle)
+{
+    handle_entry_t *entry = lookup(heap, handle);
+    if (!entry)
+        return NULL;
+
+    entry->pins++;
+    return BLOCK_PAYLOAD(entry->block);
+}
+
+void heap_unpin(memflex_heap_t *heap, memflex_handle_t handle)
+{
+    handle_entry_t *entry = lookup(heap, handle);
+    if (entry && entry->pins > 0)
+        entry->pins--;
+}
+
+static int is_movable(memflex_heap_t *heap, block_header_t *block)
+{
+    return !block->is_free && block->slot != 0 && heap->handles[block->slot].pins == 0;
+}
+
+/* Swap hole and the live block right after it; returns the hole at its new place */
+static block_header_t *slide_down(memflex_heap_t *heap, block_header_t *hole)
+{
+    block_header_t *live = block_next(heap, hole);
+    uintptr_t prev = hole->prev;
+    block_header_t *after = block_next(heap, live);
+    size_t gap = hole->size;
+    size_t live_size = live->size;
+
+    mf_index_remove(heap, hole);
+    memmove(hole, live, BLOCK_HEADER_SIZE + live_size);
+    block_header_t *moved = hole;
+    block_header_t *freed = (block_header_t *)((char *)moved + BLOCK_HEADER_SIZE + live_size);
+
+    freed->size = gap;
+    freed->is_free = 1;
+    freed->slot = 0;
+    block_set_prev(heap, freed, moved);
+    block_set_next(heap, freed, after);
+    if (after)
+    {
+        block_set_prev(heap, after, freed);
+    }
+
+    moved->prev = prev;
+    block_set_next(heap, moved, freed);
+    if (heap->tail == live)
+    {
+        heap->tail = freed;
+    }
+    heap->handles[moved->slot].block = moved;
+    mf_profile_move(BLOCK_PAYLOAD(live), BLOCK_PAYLOAD(moved));
+    mf_index_insert(heap, freed);
+
+    return mf_coalesce(heap, freed);
+}
+
+/* Copy the live block after hole into it when they are not contiguous (separate extensions) */
+static block_header_t *relocate(memflex_heap_t *heap, block_header_t *hole)
+{
+    block_header_t *live = block_next(heap, hole);
+
+    mf_index_remove(heap, hole);
+    hole->is_free = 0;
+    mf_split_block(heap, hole, live->size);
+    hole->slot = live->slot;
+    memcpy(BLOCK_PAYLOAD(hole), BLOCK_PAYLOAD(live), live->size);
+    heap->handles[hole->slot].block = hole;
+    mf_profile_move(BLOCK_PAYLOAD(live), BLOCK_PAYLOAD(hole));
+
+    live->is_free = 1;
+    mf_index_insert(heap, live);
+    mf_coalesce(heap, live);
+
+    return block_next(heap, hole);
+}
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+int heap_compact(memflex_heap_t *heap, unsigned long budget_us)
+{
+    // Such heaps hold no handles (see heap_halloc), and walking a shared heap's
+    // list without its lock would race with the other processes
+    if (!heap || heap->magic != HEAP_MAGIC || heap->backing == HEAP_BACKING_SHARED ||
+        (heap->flags & HEAP_FLAG_OOB_META))
+        return 1;
+
+    uint64_t deadline = budget_us ? now_us() + budget_us : 0;
+    block_header_t *current = heap->compact_cursor ? heap->compact_cursor : heap->start;
+
+    while (current != NULL)
+    {
+        block_header_t *next = block_next(heap, current);
+
+        if (!current->is_free || next == NULL || next->is_free)
+        {
+            current = next;
+        }
+        else if (!is_movable(heap, next))
+        {
+            current = block_next(heap, next);
+        }
+        else if (mf_blocks_adjacent(current, next))
+        {
+            current = slide_down(heap, current);
+        }
+        else if (current->size >= next->size)
+        {
+            current = relocate(heap, current);
+        }
+        else
+        {
+            current = next;
+        }
+
+        if (deadline && current && now_us() >= deadline)
+        {
+            heap->compact_cursor = current;
+            return 0;
+        }
+    }
+
+    heap->compact_cursor = NULL;
+    return 1;
+}
+
+/* Find the mapping of an mmap-backed heap that holds addr; *size_slot is its recorded size */
+static char *find_mapping(memflex_heap_t *heap, void *addr, size_t **size_slot, heap_segment_t **seg_out)
+{
+    for (heap_segment_t *seg = heap->segments; seg; seg = seg->next)
+    {
+        if ((char *)addr >= (char *)seg && (char *)addr < (char *)seg + seg->size)
+        {
+            *size_slot = &seg->size;
+            *seg_out = seg;
+            return (char *)seg;
+        }
+    }
+    *size_slot = &heap->region_size;
+    *seg_out = NULL;
+    return (char *)heap->region;
+}
+
+/* Both read the tail's header and payload, so they run while its memory is still mapped */
+static void unlink_tail(memflex_heap_t *heap, block_header_t *tail)
+{
+    mf_index_remove(heap, tail);
+    heap->tail = block_prev(heap, tail);
+    heap->tail->next = 0;
+    if (heap->compact_cursor == tail)
+        heap->compact_cursor = NULL;
+}
+
+static void relink_tail(memflex_heap_t *heap, block_header_t *tail)
+{
+    block_set_next(heap, heap->tail, tail);
+    heap->tail = tail;
+    mf_index_insert(heap, tail);
+}
+
+size_t heap_trim(memflex_heap_t *heap)
+{
+    if (!heap || heap->magic != HEAP_MAGIC || heap->start == NULL)
+        return 0;
+    if (heap->backing != HEAP_BACKING_SBRK && heap->backing != HEAP_BACKING_MMAP)
+        return 0;
+
+    block_header_t *tail = heap->tail;
+    if (!tail->is_free)
+        return 0;
+
+    char *end = (char *)BLOCK_PAYLOAD(tail) + tail->size;
+    size_t released = 0;
+
+    if (heap->backing == HEAP_BACKING_SBRK)
+    {
+        if (sbrk(0) != end)
+            return 0; // Someone else moved the break past us
+
+        int whole = tail != heap->start;
+        released = whole ? BLOCK_HEADER_SIZE + tail->size : tail->size - 8;
+        if (released == 0)
+            return 0;
+
+        if (whole)
+            unlink_tail(heap, tail);
+        else
+            mf_index_remove(heap, tail);
+
+        if (sbrk(-(intptr_t)released) == (void *)-1)
+        {
+            if (whole)
+                relink_tail(heap, tail);
+            else
+                mf_index_insert(heap, tail);
+            return 0;
+        }
+
+        if (!whole)
+        {
+            tail->size = 8;
+            mf_index_insert(heap, tail);
+        }
+    }
+    else
+    {
+        size_t *map_size;
+        heap_segment_t *seg;
+        char *base = find_mapping(heap, tail, &map_size, &seg);
+        if (base + *map_size != end)
+            return 0;
+
+        if (seg && (char *)tail == base + SEGMENT_HEADER_SIZE && tail != heap->start)
+        {
+            // The whole extra mapping is free: drop it
+            heap_segment_t **link = &heap->segments;
+            while (*link != seg)
+            {
+                link = &(*link)->next;
+            }
+            *link = seg->next;
+            unlink_tail(heap, tail);
+            released = seg->size;
+            munmap(seg, seg->size);
+        }
+        else
+        {
+            char *cut = (char *)mf_page_align((size_t)BLOCK_PAYLOAD(tail) + 8);
+            if (cut >= end)
+                return 0;
+            released = end - cut;
+            mf_index_remove(heap, tail);
+            munmap(cut, released);
+            *map_size -= released;
+            tail->size -= released;
+            mf_index_insert(heap, tail);
+        }
+    }
+
+    heap->total_size -= released;
+    return released;
+}
@@ -0,0 +1,282 @@
+#define _GNU_SOURCE
+#include "memory_internal.h"
+#include <string.h>
+#include <sys/mman.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FREE_INDEX_X86 1
+#endif
+
+/*
+ * Free-size index (HEAP_FLAG_FREE_INDEX). Every free block owns one slot:
+ * free_sizes[slot] is its size in 8-byte units and free_blocks[slot] the
+ * block, with block->slot pointing back. Removal swaps the last slot in, so
+ * both arrays stay packed and best/worst-fit become a min/max reduction over
+ * one contiguous uint32_t array instead of a walk over block headers.
+ * Once a heap has switched to TLSF the same hooks feed its lists instead.
+ */
+
+#define FREE_INDEX_MIN 256
+#define NOT_FOUND ((size_t)-1)
+
+static uint32_t size_units(size_t size)
+{
+    size_t units = size >> 3;
+    return units > UINT32_MAX ? UINT32_MAX : (uint32_t)units;
+}
+
+/* Both arrays share one mapping: free_cap sizes followed by free_cap block pointers */
+static size_t index_bytes(uint32_t cap)
+{
+    return (size_t)cap * (sizeof(uint32_t) + sizeof(block_header_t *));
+}
+
+void mf_index_release(memflex_heap_t *heap)
+{
+    if (heap->free_sizes)
+        munmap(heap->free_sizes, index_bytes(heap->free_cap));
+    heap->free_sizes = NULL;
+    heap->free_blocks = NULL;
+    heap->free_cap = 0;
+    heap->free_count = 0;
+}
+
+static int grow_index(memflex_heap_t *heap)
+{
+    uint32_t new_cap = heap->free_cap ? heap->free_cap * 2 : FREE_INDEX_MIN;
+    void *mem = mmap(NULL, index_bytes(new_cap), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return -1;
+
+    uint32_t *sizes = mem;
+    block_header_t **blocks = (block_header_t **)(sizes + new_cap);
+    uint32_t count = heap->free_count;
+    if (count)
+    {
+        memcpy(sizes, heap->free_sizes, count * sizeof(uint32_t));
+        memcpy(blocks, heap->free_blocks, count * sizeof(block_header_t *));
+    }
+
+    mf_index_release(heap);
+    heap->free_sizes = sizes;
+    heap->free_blocks = blocks;
+    heap->free_cap = new_cap;
+    heap->free_count = count;
+    return 0;
+}
+
+void mf_index_insert(memflex_heap_t *heap, block_header_t *block)
+{
+    if (heap->tlsf)
+    {
+        mf_tlsf_insert(heap, block);
+        return;
+    }
+    if (!(heap->flags & HEAP_FLAG_FREE_INDEX))
+        return;
+
+    if (heap->free_count == heap->free_cap && grow_index(heap) != 0)
+    {
+        // Out of memory for the index: fall back to list walks for good
+        mf_index_release(heap);
+        heap->flags &= ~HEAP_FLAG_FREE_INDEX;
+        return;
+    }
+
+    uint32_t slot = heap->free_count++;
+    heap->free_sizes[slot] = size_units(block->size);
+    heap->free_blocks[slot] = block;
+    block->slot = slot;
+}
+
+void mf_index_remove(memflex_heap_t *heap, block_header_t *block)
+{
+    if (heap->tlsf)
+    {
+        mf_tlsf_remove(heap, block);
+        return;
+    }
+    if (!(heap->flags & HEAP_FLAG_FREE_INDEX))
+        return;
+
+    uint32_t slot = block->slot;
+    uint32_t last = --heap->free_count;
+    if (slot != last)
+    {
+        heap->free_sizes[slot] = heap->free_sizes[last];
+        heap->free_blocks[slot] = heap->free_blocks[last];
+        heap->free_blocks[slot]->slot = slot;
+    }
+}
+
+void mf_index_update(memflex_heap_t *heap, block_header_t *block)
+{
+    if (heap->tlsf)
+    {
+        // The size class may have changed
+        mf_tlsf_remove(heap, block);
+        mf_tlsf_insert(heap, block);
+        return;
+    }
+    if (!(heap->flags & HEAP_FLAG_FREE_INDEX))
+        return;
+
+    heap->free_sizes[block->slot] = size_units(block->size);
+}
+
+/* Scalar reference: smallest entry >= need (best) or largest entry (worst) */
+static size_t search_scalar(const uint32_t *sizes, size_t n, uint32_t need, int worst)
+{
+    size_t found = NOT_FOUND;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (worst ? (found == NOT_FOUND || sizes[i] > sizes[found])
+                  : (sizes[i] >= need && (found == NOT_FOUND || sizes[i] < sizes[found])))
+        {
+            found = i;
+        }
+    }
+    if (worst && found != NOT_FOUND && sizes[found] < need)
+        return NOT_FOUND;
+    return found;
+}
+
+#ifdef FREE_INDEX_X86
+
+/* Fold the lanes, then the scalar tail, into the best value seen */
+static uint32_t fold(const uint32_t *lanes, int count, const uint32_t *tail, size_t tail_n, uint32_t need, int worst)
+{
+    uint32_t acc = worst ? 0 : UINT32_MAX;
+    for (int i = 0; i < count; i++)
+    {
+        acc = worst ? (lanes[i] > acc ? lanes[i] : acc) : (lanes[i] < acc ? lanes[i] : acc);
+    }
+    for (size_t i = 0; i < tail_n; i++)
+    {
+        if (worst ? tail[i] > acc : (tail[i] >= need && tail[i] < acc))
+            acc = tail[i];
+    }
+    return acc;
+}
+
+__attribute__((target("avx2"))) static size_t search_avx2(const uint32_t *sizes, size_t n, uint32_t need, int worst)
+{
+    const __m256i ones = _mm256_set1_epi32(-1);
+    const __m256i vneed = _mm256_set1_epi32((int)need);
+    __m256i acc = worst ? _mm256_setzero_si256() : ones;
+    size_t i = 0;
+
+    if (worst)
+    {
+        for (; i + 8 <= n; i += 8)
+        {
+            acc = _mm256_max_epu32(acc, _mm256_loadu_si256((const __m256i *)(sizes + i)));
+        }
+    }
+    else
+    {
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(sizes + i));
+            __m256i fits = _mm256_cmpeq_epi32(_mm256_max_epu32(v, vneed), v);
+            acc = _mm256_min_epu32(acc, _mm256_or_si256(v, _mm256_xor_si256(fits, ones)));
+        }
+    }
+
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    uint32_t target = fold(lanes, 8, sizes + i, n - i, need, worst);
+    if (target < need)
+        return NOT_FOUND;
+
+    // Second pass: first slot holding the winning size
+    const __m256i vtarget = _mm256_set1_epi32((int)target);
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(sizes + i)), vtarget);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+        if (mask)
+            return i + (size_t)__builtin_ctz(mask);
+    }
+    for (; i < n; i++)
+    {
+        if (sizes[i] == target)
+            return i;
+    }
+    return NOT_FOUND;
+}
+
+__attribute__((target("sse4.1"))) static size_t search_sse41(const uint32_t *sizes, size_t n, uint32_t need, int worst)
+{
+    const __m128i ones = _mm_set1_epi32(-1);
+    const __m128i vneed = _mm_set1_epi32((int)need);
+    __m128i acc = worst ? _mm_setzero_si128() : ones;
+    size_t i = 0;
+
+    if (worst)
+    {
+        for (; i + 4 <= n; i += 4)
+        {
+            acc = _mm_max_epu32(acc, _mm_loadu_si128((const __m128i *)(sizes + i)));
+        }
+    }
+    else
+    {
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(sizes + i));
+            __m128i fits = _mm_cmpeq_epi32(_mm_max_epu32(v, vneed), v);
+            acc = _mm_min_epu32(acc, _mm_or_si128(v, _mm_xor_si128(fits, ones)));
+        }
+    }
+
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    uint32_t target = fold(lanes, 4, sizes + i, n - i, need, worst);
+    if (target < need)
+        return NOT_FOUND;
+
+    const __m128i vtarget = _mm_set1_epi32((int)target);
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(sizes + i)), vtarget);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+        if (mask)
+            return i + (size_t)__builtin_ctz(mask);
+    }
+    for (; i < n; i++)
+    {
+        if (sizes[i] == target)
+            return i;
+    }
+    return NOT_FOUND;
+}
+
+#endif
+
+typedef size_t (*search_fn)(const uint32_t *, size_t, uint32_t, int);
+
+static search_fn pick_search(void)
+{
+#ifdef FREE_INDEX_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return search_avx2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return search_sse41;
+#endif
+    return search_scalar;
+}
+
+block_header_t *mf_index_find(memflex_heap_t *heap, size_t size, alloc_algo_t algo)
+{
+    static search_fn search = NULL;
+    if (!search)
+        search = pick_search();
+
+    // Requests and block sizes are multiples of 8, so comparing units is exact
+    uint32_t need = size_units(size);
+    size_t slot = search(heap->free_sizes, heap->free_count, need, algo == ALGO_WORST_FIT);
+    return slot == NOT_FOUND ? NULL : heap->free_blocks[slot];
+}
@@ -1,7 +1,12 @@
 #include <stdio.h>
 #include <memory.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 
 #define SEED 12345
 
@@ -14,8 +19,11 @@
 #define BENCH_INITIAL_ALLOCS 1000
 #define BENCH_FREES 500
 #define BENCH_SECOND_ALLOCS 500
+#define BENCH_FLAG_HEAP_SIZE (4 * 1024 * 1024)
+#define BENCH_PROFILE_INTERVAL 1024 /* About a hundred samples over Step 3's ~136 KB */
 
 void *ptrs[BENCH_INITIAL_ALLOCS];
+size_t requested[BENCH_INITIAL_ALLOCS];
 
 void run_test(alloc_algo_t algo, const char *name)
 {
@@ -187,24 +195,68 @@ typedef struct
     const char *name;
     double time;
     int total_blocks;
+    double cache_misses; /* Per Step 3 malloc, -1 if the counter is unavailable */
+    long max_latency_ns;  /* Slowest malloc of Steps 1 and 3 */
+    long p999_latency_ns; /* 99.9th percentile of the same */
+    double internal_frag; /* Share of live block bytes beyond what was requested */
+    double external_frag; /* 1 - largest free block / free bytes */
 } BenchmarkResult;
 
-BenchmarkResult run_benchmark(alloc_algo_t algo, const char *name)
+long latencies[BENCH_INITIAL_ALLOCS + BENCH_SECOND_ALLOCS];
+
+static long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* malloc through the heap, recording how long the call took */
+void *timed_malloc(memflex_heap_t *heap, size_t size, alloc_algo_t algo, int *count)
+{
+    long start = now_ns();
+    void *ptr = heap_malloc(heap, size, algo);
+    latencies[(*count)++] = now_ns() - start;
+    return ptr;
+}
+
+int compare_latency(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/* Hardware cache-miss counter for this thread, or -1 (e.g. perf_event_paranoid) */
+int open_cache_miss_counter(void)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+BenchmarkResult run_benchmark(memflex_heap_t *heap, alloc_algo_t algo, const char *name)
 {
     printf("========================================\n");
     printf("BENCHMARK ALGORITHM: %s\n", name);
     printf("========================================\n");
 
-    my_memory_reset();
     srand(12345);
 
     for (int i = 0; i < BENCH_INITIAL_ALLOCS; i++)
         ptrs[i] = NULL;
 
+    int timed = 0;
     for (int i = 0; i < BENCH_INITIAL_ALLOCS; i++)
     {
         size_t size = rand() % (MAX_SIZE - MIN_SIZE + 1) + MIN_SIZE;
-        ptrs[i] = my_malloc(size, algo);
+        ptrs[i] = timed_malloc(heap, size, algo, &timed);
+        requested[i] = size;
     }
 
     int freed_count = 0;
@@ -213,12 +265,20 @@ BenchmarkResult run_benchmark(alloc_algo_t algo, const char *name)
         int idx = rand() % BENCH_INITIAL_ALLOCS;
         if (ptrs[idx] != NULL)
         {
-            my_free(ptrs[idx]);
+            heap_free(heap, ptrs[idx]);
             ptrs[idx] = NULL;
             freed_count++;
         }
     }
 
+    int counter = open_cache_miss_counter();
+    if (counter >= 0)
+    {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    size_t samples_before = heap_profile_samples();
     clock_t start_time = clock();
 
     int alloc_count = 0;
@@ -227,26 +287,98 @@ BenchmarkResult run_benchmark(alloc_algo_t algo, const char *name)
         if (ptrs[i] == NULL)
         {
             size_t size = rand() % (MAX_SIZE - MIN_SIZE + 1) + MIN_SIZE;
-            ptrs[i] = my_malloc(size, algo);
+            ptrs[i] = timed_malloc(heap, size, algo, &timed);
+            requested[i] = size;
             alloc_count++;
         }
     }
 
     clock_t end_time = clock();
+    size_t samples = heap_profile_samples() - samples_before;
     double time_taken = ((double)(end_time - start_time)) / CLOCKS_PER_SEC;
 
+    double cache_misses = -1.0;
+    if (counter >= 0)
+    {
+        long long misses = 0;
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter, &misses, sizeof(misses)) == sizeof(misses))
+            cache_misses = (double)misses / alloc_count;
+        close(counter);
+    }
+
+    qsort(latencies, timed, sizeof(long), compare_latency);
+    long max_latency = latencies[timed - 1];
+    long p999_latency = latencies[(timed - 1) * 999 / 1000];
+
+    // Internal: rounding inside live blocks; external: free space not usable as one block
+    size_t live_bytes = 0, asked_bytes = 0, largest_free = 0;
+    for (int i = 0; i < BENCH_INITIAL_ALLOCS; i++)
+    {
+        if (ptrs[i])
+        {
+            live_bytes += heap_usable_size(heap, ptrs[i]);
+            asked_bytes += requested[i];
+        }
+    }
+    size_t free_bytes = heap_get_free_bytes(heap, algo, &largest_free);
+    double internal_frag = live_bytes ? 1.0 - (double)asked_bytes / live_bytes : 0.0;
+    double external_frag = free_bytes ? 1.0 - (double)largest_free / free_bytes : 0.0;
+
     printf("Benchmark %s Completed.\n\n", name);
 
     printf("--- Performance Stats ---\n");
-    printf("Time taken for Step 3 (%d allocs): %f seconds\n", BENCH_SECOND_ALLOCS, time_taken);
-    print_block_count();
-    print_total_size();
+    printf("Time taken for Step 3 (%d allocs): %f seconds, %zu profiler samples\n", BENCH_SECOND_ALLOCS, time_taken, samples);
+    if (cache_misses >= 0)
+        printf("Cache misses per malloc: %.2f\n", cache_misses);
+    else
+        printf("Cache misses per malloc: n/a (perf counters unavailable)\n");
+    printf("malloc latency: max %ld ns, p99.9 %ld ns\n", max_latency, p999_latency);
+    printf("Fragmentation: internal %.1f%%, external %.1f%%\n", internal_frag * 100, external_frag * 100);
+    printf("Total Blocks: %d\n", heap_get_block_count(heap));
+    printf("Heap Size: %.2f KB\n", (double)heap_get_total_size(heap) / 1024.0);
     printf("-------------------------\n");
 
     BenchmarkResult result;
     result.name = name;
     result.time = time_taken;
-    result.total_blocks = get_total_block_count();
+    result.total_blocks = heap_get_block_count(heap);
+    result.cache_misses = cache_misses;
+    result.max_latency_ns = max_latency;
+    result.p999_latency_ns = p999_latency;
+    result.internal_frag = internal_frag;
+    result.external_frag = external_frag;
+    return result;
+}
+
+BenchmarkResult run_default_benchmark(alloc_algo_t algo, const char *name)
+{
+    my_memory_reset();
+    return run_benchmark(heap_default(), algo, name);
+}
+
+/* Default-heap workload with the sampling profiler on, to show its overhead. The
+ * default interval would take well under one sample in Step 3, so sample densely. */
+BenchmarkResult run_profiled_benchmark(alloc_algo_t algo, const char *name)
+{
+    heap_profile_start(BENCH_PROFILE_INTERVAL);
+    BenchmarkResult result = run_default_benchmark(algo, name);
+    heap_profile_stop();
+    return result;
+}
+
+/* Same workload on a fresh mmap heap created with HEAP_FLAG_* flags */
+BenchmarkResult run_flag_benchmark(int flags, alloc_algo_t algo, const char *name)
+{
+    memflex_heap_t *heap = heap_create_ex(HEAP_BACKING_MMAP, NULL, BENCH_FLAG_HEAP_SIZE, flags);
+    if (!heap)
+    {
+        printf("Could not create %s heap\n", name);
+        exit(1);
+    }
+
+    BenchmarkResult result = run_benchmark(heap, algo, name);
+    heap_destroy(heap);
     return result;
 }
 
@@ -258,8 +390,13 @@ void save_results_to_json(const char *filename, BenchmarkResult *results, int co
         fprintf(fp, "[\n");
         for (int i = 0; i < count; i++)
         {
-            fprintf(fp, "  {\"name\": \"%s\", \"time\": %f, \"total_blocks\": %d}%s\n",
-                    results[i].name, results[i].time, results[i].total_blocks, (i < count - 1) ? "," : "");
+            fprintf(fp, "  {\"name\": \"%s\", \"time\": %f, \"total_blocks\": %d, \"cache_misses_per_malloc\": %.2f, "
+                        "\"max_latency_ns\": %ld, \"p999_latency_ns\": %ld, "
+                        "\"internal_frag\": %.4f, \"external_frag\": %.4f}%s\n",
+                    results[i].name, results[i].time, results[i].total_blocks, results[i].cache_misses,
+                    results[i].max_latency_ns, results[i].p999_latency_ns,
+                    results[i].internal_frag, results[i].external_frag,
+                    (i < count - 1) ? "," : "");
         }
         fprintf(fp, "]\n");
         fclose(fp);
@@ -281,12 +418,26 @@ int main()
     run_test(ALGO_BEST_FIT, "BEST_FIT");
     run_test(ALGO_WORST_FIT, "WORST_FIT");
 
-    BenchmarkResult results[3];
-    results[0] = run_benchmark(ALGO_FIRST_FIT, "FIRST_FIT");
-    results[1] = run_benchmark(ALGO_BEST_FIT, "BEST_FIT");
-    results[2] = run_benchmark(ALGO_WORST_FIT, "WORST_FIT");
-
-    save_results_to_json("results.json", results, 3);
+    BenchmarkResult results[14];
+    results[0] = run_default_benchmark(ALGO_FIRST_FIT, "FIRST_FIT");
+    results[1] = run_default_benchmark(ALGO_BEST_FIT, "BEST_FIT");
+    results[2] = run_default_benchmark(ALGO_WORST_FIT, "WORST_FIT");
+
+    // The flag variants run on an mmap heap, so compare them against a plain heap of the same kind
+    results[3] = run_flag_benchmark(0, ALGO_FIRST_FIT, "FIRST_FIT_MMAP");
+    results[4] = run_flag_benchmark(0, ALGO_BEST_FIT, "BEST_FIT_MMAP");
+    results[5] = run_flag_benchmark(0, ALGO_WORST_FIT, "WORST_FIT_MMAP");
+    results[6] = run_flag_benchmark(HEAP_FLAG_OOB_META, ALGO_FIRST_FIT, "FIRST_FIT_OOB");
+    results[7] = run_flag_benchmark(HEAP_FLAG_OOB_META, ALGO_BEST_FIT, "BEST_FIT_OOB");
+    results[8] = run_flag_benchmark(HEAP_FLAG_OOB_META, ALGO_WORST_FIT, "WORST_FIT_OOB");
+    results[9] = run_flag_benchmark(HEAP_FLAG_FREE_INDEX, ALGO_BEST_FIT, "BEST_FIT_SOA");
+    results[10] = run_flag_benchmark(HEAP_FLAG_FREE_INDEX, ALGO_WORST_FIT, "WORST_FIT_SOA");
+
+    results[11] = run_profiled_benchmark(ALGO_FIRST_FIT, "FIRST_FIT_PROF");
+    results[12] = run_default_benchmark(ALGO_TLSF, "TLSF");
+    results[13] = run_default_benchmark(ALGO_BUDDY, "BUDDY");
+
+    save_results_to_json("results.json", results, 14);
 
     return 0;
 }
@@ -1,15 +1,45 @@
 #define _GNU_SOURCE
-#include "memory.h"
+#include "memory_internal.h"
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 
-static void *heap_start_addr = NULL;
-static size_t heap_total_size = 0;
-
-#define BLOCK_HEADER_SIZE sizeof(block_header_t)
 #define DEFAULT_HEAP_SIZE (640) // 640 Byte For Visual Test
 // #define DEFAULT_HEAP_SIZE (65536) //64KB For Benchmark
+#define DEFAULT_GROW_MAX (1024 * 1024) // Largest single extension unless configured
+
+/* Instance behind the my_* functions; lives outside the heap so reset can forget it */
+static memflex_heap_t default_heap = {
+    .backing = HEAP_BACKING_SBRK,
+    .magic = HEAP_MAGIC,
+    .grow_min = DEFAULT_HEAP_SIZE,
+    .grow_max = DEFAULT_GROW_MAX,
+};
+
+size_t mf_page_align(size_t size)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (size + page - 1) & ~(page - 1);
+}
+
+/* Lay out a single free block over [mem, mem + size) */
+block_header_t *mf_init_free_block(void *mem, size_t size)
+{
+    block_header_t *block = (block_header_t *)mem;
+    block->size = size - BLOCK_HEADER_SIZE;
+    block->is_free = 1;
+    block->slot = 0;
+    block->next = 0;
+    block->prev = 0;
+    return block;
+}
+
+/* Blocks from separate sbrk/mmap calls may sit next to each other in the list without touching */
+int mf_blocks_adjacent(block_header_t *a, block_header_t *b)
+{
+    return (char *)a + BLOCK_HEADER_SIZE + a->size == (char *)b;
+}
 
 void heap_init(void *start_addr, size_t size)
 {
@@ -18,14 +48,9 @@ void heap_init(void *start_addr, size_t size)
         return;
     }
 
-    heap_start_addr = start_addr;
-    heap_total_size = size;
-
-    block_header_t *first_block = (block_header_t *)start_addr;
-    first_block->size = size - BLOCK_HEADER_SIZE;
-    first_block->is_free = 1;
-    first_block->next = NULL;
-    first_block->prev = NULL;
+    default_heap.start = mf_init_free_block(start_addr, size);
+    default_heap.tail = default_heap.start;
+    default_heap.total_size = size;
 }
 
 int my_memory_init(size_t size)
@@ -40,15 +65,182 @@ int my_memory_init(size_t size)
     return 0;
 }
 
+/* Retire the profiler's samples in a heap whose memory is about to go away. sbrk
+ * extensions are only recorded in the block list, so those go by contiguous runs. */
+static void forget_samples(memflex_heap_t *heap)
+{
+    if (heap->region)
+        mf_profile_forget_range(heap->region, (char *)heap->region + heap->region_size);
+    if (heap->backing == HEAP_BACKING_MMAP)
+    {
+        for (heap_segment_t *seg = heap->segments; seg; seg = seg->next)
+        {
+            mf_profile_forget_range(seg, (char *)seg + seg->size);
+        }
+    }
+    else if (heap->backing == HEAP_BACKING_SBRK && !(heap->flags & HEAP_FLAG_OOB_META))
+    {
+        block_header_t *run = heap->start;
+        for (block_header_t *b = heap->start; b != NULL; b = block_next(heap, b))
+        {
+            block_header_t *next = block_next(heap, b);
+            if (next && mf_blocks_adjacent(b, next))
+                continue;
+            mf_profile_forget_range(run, (char *)BLOCK_PAYLOAD(b) + b->size);
+            run = next;
+        }
+    }
+}
+
 void my_memory_reset(void)
 {
-    heap_start_addr = NULL;
-    heap_total_size = 0;
+    forget_samples(&default_heap);
+    mf_release_handles(&default_heap);
+    mf_index_release(&default_heap);
+    mf_tlsf_release(&default_heap);
+    mf_buddy_release(&default_heap);
+    default_heap.start = NULL;
+    default_heap.tail = NULL;
+    default_heap.total_size = 0;
+}
+
+void my_memory_cleanup(void)
+{
+    my_memory_reset();
+}
+
+memflex_heap_t *heap_default(void)
+{
+    return &default_heap;
 }
 
-static block_header_t *find_free_block(size_t size, alloc_algo_t algo)
+memflex_heap_t *heap_create(heap_backing_t backing, void *buffer, size_t size)
 {
-    block_header_t *current = (block_header_t *)heap_start_addr;
+    return heap_create_ex(backing, buffer, size, 0);
+}
+
+memflex_heap_t *heap_create_ex(heap_backing_t backing, void *buffer, size_t size, uint32_t flags)
+{
+    void *region;
+    size_t region_size;
+
+    switch (backing)
+    {
+    case HEAP_BACKING_BUFFER:
+    {
+        if (!buffer)
+            return NULL;
+        uintptr_t aligned = ((uintptr_t)buffer + 7) & ~(uintptr_t)7;
+        if (size < aligned - (uintptr_t)buffer)
+            return NULL;
+        region = (void *)aligned;
+        region_size = (size - (aligned - (uintptr_t)buffer)) & ~(size_t)7;
+        break;
+    }
+    case HEAP_BACKING_MMAP:
+        region_size = mf_page_align(size);
+        region = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED)
+            return NULL;
+        break;
+    case HEAP_BACKING_SBRK:
+        region_size = (size + 7) & ~(size_t)7;
+        region = sbrk(region_size);
+        if (region == (void *)-1)
+            return NULL;
+        break;
+    default:
+        return NULL;
+    }
+
+    if (region_size < HEAP_HEADER_SIZE + BLOCK_HEADER_SIZE + 8)
+    {
+        if (backing == HEAP_BACKING_MMAP)
+            munmap(region, region_size);
+        return NULL;
+    }
+
+    memflex_heap_t *heap = (memflex_heap_t *)region;
+    memset(heap, 0, sizeof(*heap));
+    heap->backing = backing;
+    heap->magic = HEAP_MAGIC;
+    heap->region = region;
+    heap->region_size = region_size;
+    heap->total_size = region_size;
+    heap->flags = flags;
+    heap->grow_min = DEFAULT_HEAP_SIZE;
+    heap->grow_max = DEFAULT_GROW_MAX;
+
+    if (flags & HEAP_FLAG_OOB_META)
+    {
+        if (mf_oob_init(heap, (char *)region + HEAP_HEADER_SIZE, region_size - HEAP_HEADER_SIZE) != 0)
+        {
+            if (backing == HEAP_BACKING_MMAP)
+                munmap(region, region_size);
+            return NULL;
+        }
+        return heap;
+    }
+
+    heap->start = mf_init_free_block((char *)region + HEAP_HEADER_SIZE, region_size - HEAP_HEADER_SIZE);
+    heap->tail = heap->start;
+    mf_index_insert(heap, heap->start);
+    return heap;
+}
+
+void heap_destroy(memflex_heap_t *heap)
+{
+    if (!heap || heap->magic != HEAP_MAGIC)
+        return;
+
+    if (heap == &default_heap)
+    {
+        my_memory_reset();
+        return;
+    }
+
+    if (heap->backing == HEAP_BACKING_SHARED)
+    {
+        mf_shared_close(heap);
+        return;
+    }
+
+    heap->magic = 0;
+    forget_samples(heap);
+    mf_release_handles(heap);
+    mf_index_release(heap);
+    mf_tlsf_release(heap);
+    mf_buddy_release(heap);
+    if (heap->backing == HEAP_BACKING_MMAP)
+    {
+        heap_segment_t *seg = heap->segments;
+        while (seg)
+        {
+            heap_segment_t *next = seg->next;
+            munmap(seg, seg->size);
+            seg = next;
+        }
+        munmap(heap->region, heap->region_size);
+    }
+    // sbrk memory cannot be handed back out of order; buffers belong to the caller
+}
+
+static block_header_t *find_free_block(memflex_heap_t *heap, size_t size, alloc_algo_t algo)
+{
+    if (algo == ALGO_TLSF)
+    {
+        // The lists are built on first use and then kept up to date whatever the algorithm
+        if (heap->tlsf || mf_tlsf_enable(heap) == 0)
+            return mf_tlsf_find(heap, size);
+        algo = ALGO_BEST_FIT;
+    }
+
+    if ((heap->flags & HEAP_FLAG_FREE_INDEX) && algo != ALGO_FIRST_FIT)
+    {
+        return mf_index_find(heap, size, algo);
+    }
+
+    block_header_t *current = heap->start;
     block_header_t *best_block = NULL;
 
     while (current != NULL)
@@ -74,12 +266,12 @@ static block_header_t *find_free_block(size_t size, alloc_algo_t algo)
                 }
             }
         }
-        current = current->next;
+        current = block_next(heap, current);
     }
     return best_block;
 }
 
-static void split_block(block_header_t *block, size_t size)
+void mf_split_block(memflex_heap_t *heap, block_header_t *block, size_t size)
 {
     if (block->size > size + BLOCK_HEADER_SIZE)
     {
@@ -87,198 +279,511 @@ static void split_block(block_header_t *block, size_t size)
 
         new_block->size = block->size - size - BLOCK_HEADER_SIZE;
         new_block->is_free = 1;
+        new_block->slot = 0;
         new_block->next = block->next;
-        new_block->prev = block;
+        block_set_prev(heap, new_block, block);
 
-        if (block->next != NULL)
+        block_header_t *after = block_next(heap, block);
+        if (after != NULL)
         {
-            block->next->prev = new_block;
+            block_set_prev(heap, after, new_block);
         }
 
-        block->next = new_block;
+        block_set_next(heap, block, new_block);
         block->size = size;
+
+        if (heap->tail == block)
+        {
+            heap->tail = new_block;
+        }
+
+        if (block->is_free)
+        {
+            mf_index_update(heap, block);
+        }
+        mf_index_insert(heap, new_block);
     }
 }
 
-static void coalesce(block_header_t *block)
+/* Merge the next block into block; the caller has checked both are mergeable */
+void mf_absorb_next(memflex_heap_t *heap, block_header_t *block)
 {
-    if (block->next && block->next->is_free)
+    block_header_t *victim = block_next(heap, block);
+
+    if (victim->is_free)
     {
-        block->size += BLOCK_HEADER_SIZE + block->next->size;
-        block->next = block->next->next;
-        if (block->next)
-        {
-            block->next->prev = block;
-        }
+        mf_index_remove(heap, victim);
+    }
+    block->size += BLOCK_HEADER_SIZE + victim->size;
+    block->next = victim->next;
+    block_header_t *after = block_next(heap, block);
+    if (after)
+    {
+        block_set_prev(heap, after, block);
     }
 
-    if (block->prev && block->prev->is_free)
+    if (heap->compact_cursor == victim)
     {
-        block->prev->size += BLOCK_HEADER_SIZE + block->size;
-        block->prev->next = block->next;
-        if (block->next)
-        {
-            block->next->prev = block->prev;
-        }
+        heap->compact_cursor = block;
+    }
+    if (heap->tail == victim)
+    {
+        heap->tail = block;
+    }
+    if (block->is_free)
+    {
+        mf_index_update(heap, block);
+    }
+}
+
+/* Merge a free block with its free neighbours; returns the surviving block */
+block_header_t *mf_coalesce(memflex_heap_t *heap, block_header_t *block)
+{
+    block_header_t *next = block_next(heap, block);
+    if (next && next->is_free && mf_blocks_adjacent(block, next))
+    {
+        mf_absorb_next(heap, block);
+    }
+
+    block_header_t *prev = block_prev(heap, block);
+    if (prev && prev->is_free && mf_blocks_adjacent(prev, block))
+    {
+        block = prev;
+        mf_absorb_next(heap, block);
+    }
+    return block;
+}
+
+/* Get alloc_size more bytes from the heap's backing store; returns where the new block goes */
+static void *grow_backing(memflex_heap_t *heap, size_t *alloc_size, int prefault)
+{
+    switch (heap->backing)
+    {
+    case HEAP_BACKING_SBRK:
+    {
+        void *p = sbrk(*alloc_size);
+        return p == (void *)-1 ? NULL : p;
+    }
+    case HEAP_BACKING_MMAP:
+    {
+        size_t map_size = mf_page_align(*alloc_size + SEGMENT_HEADER_SIZE);
+        int populate = prefault ? MAP_POPULATE : 0;
+        heap_segment_t *seg = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | populate, -1, 0);
+        if (seg == MAP_FAILED)
+            return NULL;
+        seg->size = map_size;
+        seg->next = heap->segments;
+        heap->segments = seg;
+        *alloc_size = map_size - SEGMENT_HEADER_SIZE;
+        return (char *)seg + SEGMENT_HEADER_SIZE;
+    }
+    default:
+        return NULL; // Caller buffers and shared regions are fixed-size
     }
 }
 
-static block_header_t *extend_heap(size_t size)
+static block_header_t *extend_heap(memflex_heap_t *heap, size_t size, int prefault)
 {
     size = (size + 7) & ~7;
 
-    size_t num_units = (size + DEFAULT_HEAP_SIZE - 1) / DEFAULT_HEAP_SIZE;
-    size_t alloc_size = num_units * DEFAULT_HEAP_SIZE;
+    // Grow in proportion to the heap so the number of extensions stays logarithmic
+    size_t step = heap->total_size;
+    if (step < heap->grow_min)
+        step = heap->grow_min;
+    if (step > heap->grow_max)
+        step = heap->grow_max;
+    size_t alloc_size = size > step ? size : (step + 7) & ~(size_t)7;
 
-    void *p = sbrk(alloc_size);
-    if (p == (void *)-1)
+    void *p = grow_backing(heap, &alloc_size, prefault);
+    if (p == NULL)
     {
         return NULL;
     }
 
-    heap_total_size += alloc_size;
+    heap->total_size += alloc_size;
 
-    block_header_t *new_block = (block_header_t *)p;
-    new_block->size = alloc_size - BLOCK_HEADER_SIZE;
-    new_block->is_free = 1;
-    new_block->next = NULL;
-    new_block->prev = NULL;
+    block_header_t *new_block = mf_init_free_block(p, alloc_size);
 
-    block_header_t *current = (block_header_t *)heap_start_addr;
-    if (current)
+    if (heap->tail)
     {
-        while (current->next != NULL)
-        {
-            current = current->next;
-        }
-        current->next = new_block;
-        new_block->prev = current;
+        block_set_next(heap, heap->tail, new_block);
+        block_set_prev(heap, new_block, heap->tail);
     }
     else
     {
-        heap_start_addr = new_block;
+        heap->start = new_block;
     }
+    heap->tail = new_block;
+    mf_index_insert(heap, new_block);
 
-    coalesce(new_block);
-
-    return new_block;
+    return mf_coalesce(heap, new_block);
 }
 
-void *my_malloc(size_t size, alloc_algo_t algo)
-{
-    if (size == 0)
-        return NULL;
+static void *buddy_malloc_locked(memflex_heap_t *heap, size_t size);
 
-    if (heap_start_addr == NULL)
+static void *malloc_locked(memflex_heap_t *heap, size_t size, alloc_algo_t algo)
+{
+    if (algo == ALGO_BUDDY)
     {
-        if (my_memory_init(DEFAULT_HEAP_SIZE) != 0)
-        {
-            return NULL;
-        }
+        // Buddy free lists hold process-local pointers and need in-band blocks to carve from
+        if (heap->backing != HEAP_BACKING_SHARED && !(heap->flags & HEAP_FLAG_OOB_META))
+            return buddy_malloc_locked(heap, size);
+        algo = ALGO_FIRST_FIT;
     }
 
+    if (heap->flags & HEAP_FLAG_OOB_META)
+        return mf_oob_malloc(heap, size, algo);
+
+    if (size == 0)
+        return NULL;
+
     size = (size + 7) & ~7;
 
-    block_header_t *block = find_free_block(size, algo);
+    block_header_t *block = find_free_block(heap, size, algo);
 
     if (block == NULL)
     {
         size_t needed = size + BLOCK_HEADER_SIZE;
-        block = extend_heap(needed);
+        block = extend_heap(heap, needed, 0);
 
         if (block == NULL)
         {
             return NULL;
         }
 
-        block = find_free_block(size, algo);
+        block = find_free_block(heap, size, algo);
     }
 
     if (block)
     {
-        split_block(block, size);
+        mf_index_remove(heap, block);
         block->is_free = 0;
-        return (void *)((char *)block + BLOCK_HEADER_SIZE);
+        block->slot = 0;
+        mf_split_block(heap, block, size);
+        return BLOCK_PAYLOAD(block);
     }
 
     return NULL;
 }
 
-void my_free(void *ptr)
+static void free_locked(memflex_heap_t *heap, void *ptr)
 {
-    if (!ptr)
+    if (heap->buddy && mf_buddy_owns(heap, ptr))
+    {
+        mf_buddy_free(heap, ptr);
+        return;
+    }
+
+    if (heap->flags & HEAP_FLAG_OOB_META)
+    {
+        mf_oob_free(heap, ptr);
         return;
+    }
 
-    block_header_t *block = (block_header_t *)((char *)ptr - BLOCK_HEADER_SIZE);
+    block_header_t *block = PAYLOAD_BLOCK(ptr);
     block->is_free = 1;
+    mf_index_insert(heap, block);
 
-    coalesce(block);
+    mf_coalesce(heap, block);
 }
 
-void *my_calloc(size_t num, size_t size, alloc_algo_t algo)
+/* The buddy region is one used block of the heap, taken on the first ALGO_BUDDY request.
+ * Requests it cannot serve, too big or with no block left, go to the block list. */
+static void *buddy_malloc_locked(memflex_heap_t *heap, size_t size)
 {
-    size_t total_size = num * size;
-    void *ptr = my_malloc(total_size, algo);
-    if (ptr)
+    if (!heap->buddy)
     {
-        memset(ptr, 0, total_size);
+        void *region = malloc_locked(heap, mf_buddy_region_size(heap), ALGO_FIRST_FIT);
+        if (region && mf_buddy_init(heap, region) != 0)
+            free_locked(heap, region);
     }
-    return ptr;
+
+    void *ptr = heap->buddy ? mf_buddy_malloc(heap, size) : NULL;
+    return ptr ? ptr : malloc_locked(heap, size, ALGO_FIRST_FIT);
 }
 
-void *my_realloc(void *ptr, size_t size)
+/* Grow a buddy block, moving it out to the block list if the region has no room */
+static void *buddy_realloc_locked(memflex_heap_t *heap, void *ptr, size_t size)
 {
+    size_t have = mf_buddy_usable_size(heap, ptr);
+    if (have == 0)
+        return NULL;
+
+    void *new_ptr = mf_buddy_realloc(heap, ptr, size);
+    if (new_ptr)
+        return new_ptr;
+
+    new_ptr = malloc_locked(heap, size, ALGO_FIRST_FIT);
+    if (new_ptr)
+    {
+        memcpy(new_ptr, ptr, have);
+        mf_buddy_free(heap, ptr);
+    }
+    return new_ptr;
+}
+
+static void *realloc_locked(memflex_heap_t *heap, void *ptr, size_t size)
+{
+    if (ptr && size && heap->buddy && mf_buddy_owns(heap, ptr))
+        return buddy_realloc_locked(heap, ptr, size);
+
+    if (heap->flags & HEAP_FLAG_OOB_META)
+        return mf_oob_realloc(heap, ptr, size);
+
     if (ptr == NULL)
     {
-        return my_malloc(size, ALGO_FIRST_FIT);
+        return malloc_locked(heap, size, ALGO_FIRST_FIT);
     }
 
     if (size == 0)
     {
-        my_free(ptr);
+        free_locked(heap, ptr);
         return NULL;
     }
 
-    block_header_t *block = (block_header_t *)((char *)ptr - BLOCK_HEADER_SIZE);
+    size = (size + 7) & ~7;
+
+    block_header_t *block = PAYLOAD_BLOCK(ptr);
     size_t old_size = block->size;
 
     // Case 1: Shrinking or same size
     if (old_size >= size)
     {
-        split_block(block, size);
+        mf_split_block(heap, block, size);
         return ptr;
     }
 
     // Case 2: Growing
     // 2a. Try to merge with next block if it is free and has enough space
-    if (block->next && block->next->is_free && (old_size + BLOCK_HEADER_SIZE + block->next->size >= size))
+    block_header_t *next = block_next(heap, block);
+    if (next && next->is_free && mf_blocks_adjacent(block, next) &&
+        (old_size + BLOCK_HEADER_SIZE + next->size >= size))
     {
-        block->size += BLOCK_HEADER_SIZE + block->next->size;
-        block->next = block->next->next;
-        if (block->next)
-        {
-            block->next->prev = block;
-        }
+        mf_absorb_next(heap, block);
 
         // Split if the merged block is too big
-        split_block(block, size);
+        mf_split_block(heap, block, size);
         return ptr;
     }
 
     // 2b. Allocate new block, copy data, free old block
-    void *new_ptr = my_malloc(size, ALGO_FIRST_FIT);
+    void *new_ptr = malloc_locked(heap, size, ALGO_FIRST_FIT);
     if (new_ptr)
     {
         memcpy(new_ptr, ptr, old_size);
-        my_free(ptr);
+        free_locked(heap, ptr);
     }
     return new_ptr;
 }
 
-void print_heap_stats(void *highlight_ptr)
+/* Touch every page of a free block so later allocations don't fault. The bytes
+ * are written back unchanged: free payloads can hold TLSF list links. */
+static void prefault_block(block_header_t *block)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    volatile char *p = (volatile char *)BLOCK_PAYLOAD(block);
+    for (size_t off = 0; off < block->size; off += page)
+    {
+        p[off] = p[off];
+    }
+}
+
+void heap_set_growth(memflex_heap_t *heap, size_t min_step, size_t max_step)
+{
+    if (!heap || heap->magic != HEAP_MAGIC || min_step == 0 || max_step < min_step)
+        return;
+
+    heap->grow_min = min_step;
+    heap->grow_max = max_step;
+}
+
+int heap_reserve(memflex_heap_t *heap, size_t bytes, int prefault)
+{
+    if (!heap || heap->magic != HEAP_MAGIC)
+        return -1;
+
+    bytes = (bytes + 7) & ~(size_t)7;
+    int rc = 0;
+    heap_lock(heap);
+
+    if (heap->flags & HEAP_FLAG_OOB_META)
+    {
+        size_t largest;
+        mf_oob_free_bytes(heap, &largest);
+        rc = largest >= bytes ? 0 : -1;
+        if (rc == 0 && prefault)
+            mf_oob_prefault(heap);
+    }
+    else if (heap->backing == HEAP_BACKING_BUFFER || heap->backing == HEAP_BACKING_SHARED)
+    {
+        // Cannot grow: one free block must already hold the request
+        block_header_t *largest = NULL;
+        for (block_header_t *b = heap->start; b != NULL; b = block_next(heap, b))
+        {
+            if (b->is_free && (!largest || b->size > largest->size))
+                largest = b;
+        }
+        rc = (largest && largest->size >= bytes) ? 0 : -1;
+        if (rc == 0 && prefault)
+            prefault_block(largest);
+    }
+    else
+    {
+        // New memory only merges with the free tail when it lands right after it;
+        // mmap segments and a break moved by someone else start a block of their own
+        block_header_t *tail = heap->tail;
+        size_t have = 0;
+        if (tail && tail->is_free && heap->backing == HEAP_BACKING_SBRK &&
+            sbrk(0) == (char *)BLOCK_PAYLOAD(tail) + tail->size)
+            have = tail->size;
+
+        if (!(tail && tail->is_free && tail->size >= bytes))
+            extend_heap(heap, bytes - have + BLOCK_HEADER_SIZE, prefault);
+
+        tail = heap->tail;
+        if (!(tail && tail->is_free && tail->size >= bytes))
+            rc = -1;
+        else if (prefault)
+            prefault_block(tail);
+    }
+
+    heap_unlock(heap);
+    return rc;
+}
+
+void *heap_malloc(memflex_heap_t *heap, size_t size, alloc_algo_t algo)
+{
+    if (!heap || heap->magic != HEAP_MAGIC)
+        return NULL;
+
+    heap_lock(heap);
+    void *ptr = malloc_locked(heap, size, algo);
+    heap_unlock(heap);
+    if (heap->backing != HEAP_BACKING_SHARED)
+        mf_profile_alloc(ptr, size);
+    return ptr;
+}
+
+void heap_free(memflex_heap_t *heap, void *ptr)
+{
+    if (!ptr || !heap || heap->magic != HEAP_MAGIC)
+        return;
+
+    // Forget the sample first: once freed, another thread may get the address back
+    mf_profile_free(ptr);
+    heap_lock(heap);
+    free_locked(heap, ptr);
+    heap_unlock(heap);
+}
+
+void *heap_calloc(memflex_heap_t *heap, size_t num, size_t size, alloc_algo_t algo)
+{
+    // A wrapped product would hand back a block smaller than asked for
+    if (size && num > SIZE_MAX / size)
+        return NULL;
+
+    size_t total_size = num * size;
+    void *ptr = heap_malloc(heap, total_size, algo);
+    if (ptr)
+    {
+        memset(ptr, 0, total_size);
+    }
+    return ptr;
+}
+
+void *heap_realloc(memflex_heap_t *heap, void *ptr, size_t size)
+{
+    if (!heap || heap->magic != HEAP_MAGIC)
+        return NULL;
+
+    heap_lock(heap);
+    void *new_ptr = realloc_locked(heap, ptr, size);
+    heap_unlock(heap);
+
+    // Profiled as a free of the old block plus an allocation of the new size. A failed
+    // grow keeps the old block, so its sample stays; only unlocked heaps are sampled,
+    // so nobody else can have been handed the old address in between.
+    if (ptr && (new_ptr || size == 0))
+        mf_profile_free(ptr);
+    if (heap->backing != HEAP_BACKING_SHARED)
+        mf_profile_alloc(new_ptr, size);
+    return new_ptr;
+}
+
+void *my_malloc(size_t size, alloc_algo_t algo)
+{
+    if (size == 0)
+        return NULL;
+
+    if (default_heap.start == NULL)
+    {
+        if (my_memory_init(DEFAULT_HEAP_SIZE) != 0)
+        {
+            return NULL;
+        }
+    }
+
+    return heap_malloc(&default_heap, size, algo);
+}
+
+void my_memory_set_growth(size_t min_step, size_t max_step)
+{
+    heap_set_growth(&default_heap, min_step, max_step);
+}
+
+int my_memory_reserve(size_t bytes, int prefault)
+{
+    return heap_reserve(&default_heap, bytes, prefault);
+}
+
+int my_memory_set_buddy(unsigned order, unsigned min_order)
+{
+    return heap_set_buddy(&default_heap, order, min_order);
+}
+
+void my_free(void *ptr)
+{
+    heap_free(&default_heap, ptr);
+}
+
+void *my_calloc(size_t num, size_t size, alloc_algo_t algo)
+{
+    // A wrapped product would hand back a block smaller than asked for
+    if (size && num > SIZE_MAX / size)
+        return NULL;
+
+    size_t total_size = num * size;
+    void *ptr = my_malloc(total_size, algo);
+    if (ptr)
+    {
+        memset(ptr, 0, total_size);
+    }
+    return ptr;
+}
+
+void *my_realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+    {
+        return my_malloc(size, ALGO_FIRST_FIT);
+    }
+
+    return heap_realloc(&default_heap, ptr, size);
+}
+
+void heap_print_stats(memflex_heap_t *heap, void *highlight_ptr)
 {
+    heap_lock(heap);
     printf("--- Heap Stats ---\n");
-    block_header_t *current = (block_header_t *)heap_start_addr;
+    if (heap->flags & HEAP_FLAG_OOB_META)
+    {
+        mf_oob_print(heap, highlight_ptr);
+        printf("------------------\n");
+        heap_unlock(heap);
+        return;
+    }
+
+    block_header_t *current = heap->start;
     int i = 0;
     while (current != NULL)
     {
@@ -295,10 +800,16 @@ void print_heap_stats(void *highlight_ptr)
         if (highlight)
             printf("----------------------------------------\n");
 
-        current = current->next;
+        current = block_next(heap, current);
     }
     printf("Total Blocks: %d\n", i);
     printf("------------------\n");
+    heap_unlock(heap);
+}
+
+void print_heap_stats(void *highlight_ptr)
+{
+    heap_print_stats(&default_heap, highlight_ptr);
 }
 
 void print_block_count(void)
@@ -306,26 +817,97 @@ void print_block_count(void)
     printf("Total Blocks: %d\n", get_total_block_count());
 }
 
-int get_total_block_count(void)
+int heap_get_block_count(memflex_heap_t *heap)
 {
-    block_header_t *current = (block_header_t *)heap_start_addr;
+    heap_lock(heap);
+    if (heap->flags & HEAP_FLAG_OOB_META)
+    {
+        int count = mf_oob_block_count(heap);
+        heap_unlock(heap);
+        return count;
+    }
+
+    block_header_t *current = heap->start;
     int count = 0;
     while (current != NULL)
     {
         count++;
-        current = current->next;
+        current = block_next(heap, current);
     }
+    heap_unlock(heap);
     return count;
 }
 
+size_t heap_get_total_size(memflex_heap_t *heap)
+{
+    return heap->total_size;
+}
+
+size_t heap_usable_size(memflex_heap_t *heap, void *ptr)
+{
+    if (!ptr || !heap || heap->magic != HEAP_MAGIC)
+        return 0;
+
+    heap_lock(heap);
+    size_t size;
+    if (heap->buddy && mf_buddy_owns(heap, ptr))
+        size = mf_buddy_usable_size(heap, ptr);
+    else if (heap->flags & HEAP_FLAG_OOB_META)
+        size = mf_oob_usable_size(heap, ptr);
+    else
+        size = PAYLOAD_BLOCK(ptr)->size;
+    heap_unlock(heap);
+    return size;
+}
+
+size_t heap_get_free_bytes(memflex_heap_t *heap, alloc_algo_t algo, size_t *largest_free)
+{
+    if (!heap || heap->magic != HEAP_MAGIC)
+        return 0;
+
+    heap_lock(heap);
+    size_t total = 0;
+    size_t largest = 0;
+    if (algo == ALGO_BUDDY)
+    {
+        total = mf_buddy_free_bytes(heap, &largest);
+    }
+    else if (heap->flags & HEAP_FLAG_OOB_META)
+    {
+        total = mf_oob_free_bytes(heap, &largest);
+    }
+    else
+    {
+        for (block_header_t *b = heap->start; b != NULL; b = block_next(heap, b))
+        {
+            if (!b->is_free)
+                continue;
+            total += b->size;
+            if (b->size > largest)
+                largest = b->size;
+        }
+    }
+    heap_unlock(heap);
+
+    if (largest_free)
+        *largest_free = largest;
+    return total;
+}
+
+int get_total_block_count(void)
+{
+    return heap_get_block_count(&default_heap);
+}
+
 void print_total_size(void)
 {
-    block_header_t *current = (block_header_t *)heap_start_addr;
+    memflex_heap_t *heap = &default_heap;
+    block_header_t *current = heap->start;
     size_t total_size = 0;
     while (current != NULL)
     {
         total_size += current->size;
-        current = current->next;
+        current = block_next(heap, current);
     }
 
     if (total_size < 1024)
@@ -351,7 +933,8 @@ void dump_heap_state(const char *filepath, int step, const char *op, void *highl
     fprintf(f, "{\"step\": %d, \"algo\": \"%s\", \"op\": \"%s\", \"highlight\": \"%p\", \"blocks\": [",
             step, algo_name, op, highlight_ptr);
 
-    block_header_t *current = (block_header_t *)heap_start_addr;
+    memflex_heap_t *heap = &default_heap;
+    block_header_t *current = heap->start;
     int first = 1;
     while (current != NULL)
     {
@@ -360,7 +943,7 @@ void dump_heap_state(const char *filepath, int step, const char *op, void *highl
         fprintf(f, "{\"addr\": \"%p\", \"size\": %zu, \"is_free\": %s}",
                 (void *)(current + 1), current->size, current->is_free ? "true" : "false");
         first = 0;
-        current = current->next;
+        current = block_next(heap, current);
     }
     fprintf(f, "]}\n");
     fclose(f);
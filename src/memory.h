@@ -9,8 +9,9 @@ typedef struct block_header
 {
     size_t size;               /* Size of the data part */
     int is_free;               /* 1 if free, 0 if allocated */
-    struct block_header *next; /* Pointer to the next block in the list */
-    struct block_header *prev; /* Pointer to the previous block */
+    uint32_t slot;             /* Used: handle slot of a relocatable block (0 if none); free: free-index slot or TLSF list */
+    uintptr_t next;            /* Link to the next block in the list (offset from the heap base) */
+    uintptr_t prev;            /* Link to the previous block */
 } block_header_t;
 
 /* Allocation algorithms */
@@ -18,9 +19,30 @@ typedef enum
 {
     ALGO_FIRST_FIT,
     ALGO_BEST_FIT,
-    ALGO_WORST_FIT
+    ALGO_WORST_FIT,
+    ALGO_TLSF, /* Two-level segregated fit: O(1) good-fit; falls back to best-fit on shared, OOB and free-index heaps */
+    ALGO_BUDDY /* Power-of-two buddy blocks from a region of the heap; first-fit beyond the region and on shared and OOB heaps */
 } alloc_algo_t;
 
+/* Heap instance (opaque); the my_* functions operate on a default instance */
+typedef struct memflex_heap memflex_heap_t;
+
+/* Where a heap instance gets its memory from */
+typedef enum
+{
+    HEAP_BACKING_BUFFER, /* Caller-provided region, never grows */
+    HEAP_BACKING_MMAP,   /* Anonymous mappings, released by heap_destroy */
+    HEAP_BACKING_SBRK,   /* Program break, shared with the default instance */
+    HEAP_BACKING_SHARED  /* MAP_SHARED region from heap_shared_open, never grows */
+} heap_backing_t;
+
+/* heap_create_ex flags */
+#define HEAP_FLAG_OOB_META 0x1 /* Keep block metadata in a side table instead of in front of payloads; fixed size */
+#define HEAP_FLAG_FREE_INDEX 0x2 /* Keep free sizes in a packed array for SIMD best/worst-fit searches */
+
+/* heap_shared_open flags */
+#define HEAP_SHARED_FILE 0x1 /* name is a file path (survives restarts) instead of a shm_open name */
+
 /* Initialize the heap manager */
 void heap_init(void *start_addr, size_t size);
 
@@ -29,13 +51,83 @@ int my_memory_init(size_t size);
 void my_memory_cleanup(void);
 void my_memory_reset(void);
 
+/* Growth and pre-sizing. Extensions roughly double the heap, between min_step
+ * and max_step bytes. Reserve makes sure one free block of at least bytes
+ * exists, growing the heap at its end if it can; with prefault the pages are
+ * touched (or MAP_POPULATE'd) up front. */
+void my_memory_set_growth(size_t min_step, size_t max_step);
+int my_memory_reserve(size_t bytes, int prefault);
+void heap_set_growth(memflex_heap_t *heap, size_t min_step, size_t max_step);
+int heap_reserve(memflex_heap_t *heap, size_t bytes, int prefault);
+
+/* Buddy region of 2^order bytes split down to blocks of 2^min_order bytes
+ * (min_order >= 4). Set before the first ALGO_BUDDY request; defaults are a
+ * 1 MB region and 16-byte blocks. Returns -1 once the region exists. */
+int my_memory_set_buddy(unsigned order, unsigned min_order);
+int heap_set_buddy(memflex_heap_t *heap, unsigned order, unsigned min_order);
+
 /* Dynamic memory allocation functions */
 void *my_malloc(size_t size, alloc_algo_t algo);
 void my_free(void *ptr);
 void *my_calloc(size_t num, size_t size, alloc_algo_t algo);
 void *my_realloc(void *ptr, size_t size);
 
+/* Independent heap instances (buffer is only used with HEAP_BACKING_BUFFER) */
+memflex_heap_t *heap_create(heap_backing_t backing, void *buffer, size_t size);
+memflex_heap_t *heap_create_ex(heap_backing_t backing, void *buffer, size_t size, uint32_t flags);
+void heap_destroy(memflex_heap_t *heap);
+memflex_heap_t *heap_default(void);
+void *heap_malloc(memflex_heap_t *heap, size_t size, alloc_algo_t algo);
+void heap_free(memflex_heap_t *heap, void *ptr);
+void *heap_calloc(memflex_heap_t *heap, size_t num, size_t size, alloc_algo_t algo);
+void *heap_realloc(memflex_heap_t *heap, void *ptr, size_t size);
+
+/* Shared heaps: every process that opens the same name sees the same blocks,
+ * whatever address the region lands at. The first opener sizes and formats
+ * it; later openers (and reopened files) attach to the existing state. Hand
+ * allocations across processes as offsets, not pointers. */
+memflex_heap_t *heap_shared_open(const char *name, size_t size, int flags);
+size_t heap_ptr_to_offset(memflex_heap_t *heap, void *ptr);
+void *heap_offset_to_ptr(memflex_heap_t *heap, size_t offset);
+
+/* Relocatable allocations: reach the data through heap_pin/heap_unpin only.
+ * Compaction moves unpinned blocks toward the heap start, at most budget_us
+ * per call (0 = no limit), and returns 1 once a full pass is done. Trimming
+ * hands a free tail back to the backing store. Handle blocks must not be
+ * passed to heap_free/heap_realloc. */
+typedef uint32_t memflex_handle_t; /* 0 is never a valid handle */
+
+memflex_handle_t heap_halloc(memflex_heap_t *heap, size_t size);
+void heap_hfree(memflex_heap_t *heap, memflex_handle_t handle);
+void *heap_pin(memflex_heap_t *heap, memflex_handle_t handle);
+void heap_unpin(memflex_heap_t *heap, memflex_handle_t handle);
+int heap_compact(memflex_heap_t *heap, unsigned long budget_us);
+size_t heap_trim(memflex_heap_t *heap);
+
+/* Sampling heap profiler for every private heap in the process. About one
+ * allocation per sample_bytes allocated bytes (0 = HEAP_PROFILE_DEFAULT_INTERVAL)
+ * records its call stack; dumps report live and cumulative bytes per stack. */
+#define HEAP_PROFILE_DEFAULT_INTERVAL (512 * 1024)
+
+typedef enum
+{
+    HEAP_PROFILE_PPROF,        /* Legacy pprof heap profile (raw samples, heap_v2) */
+    HEAP_PROFILE_FOLDED_LIVE,  /* Folded stacks, estimated live bytes */
+    HEAP_PROFILE_FOLDED_ALLOC  /* Folded stacks, estimated cumulative bytes */
+} heap_profile_format_t;
+
+void heap_profile_start(size_t sample_bytes);
+void heap_profile_stop(void);
+size_t heap_profile_samples(void); /* Samples taken since heap_profile_start */
+int heap_profile_dump(const char *filepath, heap_profile_format_t format);
+
 /* Debugging/Info */
+void heap_print_stats(memflex_heap_t *heap, void *highlight_ptr);
+int heap_get_block_count(memflex_heap_t *heap);
+size_t heap_get_total_size(memflex_heap_t *heap);
+size_t heap_usable_size(memflex_heap_t *heap, void *ptr);
+/* Free bytes of the buddy region (ALGO_BUDDY) or of the block list (anything else) */
+size_t heap_get_free_bytes(memflex_heap_t *heap, alloc_algo_t algo, size_t *largest_free);
 void print_heap_stats(void *highlight_ptr);
 void print_block_count(void);
 int get_total_block_count(void);
@@ -0,0 +1,195 @@
+#ifndef MEMORY_INTERNAL_H
+#define MEMORY_INTERNAL_H
+
+#include "memory.h"
+#include <errno.h>
+#include <pthread.h>
+
+/* Extra mapping added to an mmap-backed heap when it grows */
+typedef struct heap_segment
+{
+    struct heap_segment *next; /* Next extra mapping */
+    size_t size;               /* Size of the whole mapping */
+} heap_segment_t;
+
+/* Slot of the handle table; a free slot links to the next free one via pins */
+typedef struct handle_entry
+{
+    block_header_t *block; /* Current location, NULL if the slot is free */
+    uint32_t pins;         /* Outstanding heap_pin calls */
+} handle_entry_t;
+
+/* Heap instance state */
+struct memflex_heap
+{
+    uintptr_t base;           /* Block links are relative to this; 0 unless shared */
+    block_header_t *start;    /* First block in the list */
+    block_header_t *tail;     /* Last block in the list (private heaps only) */
+    size_t total_size;        /* Bytes obtained from the backing store */
+    heap_backing_t backing;   /* Where new memory comes from */
+    uint32_t magic;           /* HEAP_MAGIC while the handle is valid */
+    void *region;             /* Initial region (holds this struct unless default) */
+    size_t region_size;       /* Size of the initial region */
+    heap_segment_t *segments; /* Extra mappings of an mmap-backed heap */
+    size_t grow_min;          /* Smallest extension */
+    size_t grow_max;          /* Largest extension beyond what a request needs */
+
+    handle_entry_t *handles;        /* Handle table (own mapping), slot 0 unused */
+    uint32_t handle_cap;            /* Slots in the table */
+    uint32_t handle_free;           /* First free slot, 0 if none */
+    block_header_t *compact_cursor; /* Where the next compaction step resumes */
+
+    pthread_mutex_t *lock; /* Process-shared lock inside a shared region, NULL otherwise */
+
+    uint32_t flags;  /* HEAP_FLAG_* from heap_create_ex */
+    uint32_t *meta;  /* HEAP_FLAG_OOB_META: one entry per arena chunk */
+    char *arena;     /* HEAP_FLAG_OOB_META: payload chunks */
+    size_t nchunks;  /* HEAP_FLAG_OOB_META: arena length in chunks */
+
+    uint32_t *free_sizes;         /* HEAP_FLAG_FREE_INDEX: free block sizes in 8-byte units */
+    block_header_t **free_blocks; /* HEAP_FLAG_FREE_INDEX: block owning each size entry */
+    uint32_t free_count;          /* Entries in use */
+    uint32_t free_cap;            /* Entries allocated */
+
+    struct mf_tlsf *tlsf; /* Segregated free lists (own mapping) once ALGO_TLSF is used */
+
+    struct mf_buddy *buddy;   /* Buddy state (own mapping) once ALGO_BUDDY is used */
+    uint32_t buddy_order;     /* Buddy region is 2^buddy_order bytes, 0 = default */
+    uint32_t buddy_min_order; /* Smallest buddy block, 0 = default */
+};
+
+#define HEAP_MAGIC 0x4D464C58u /* "MFLX" */
+
+#define BLOCK_HEADER_SIZE sizeof(block_header_t)
+#define HEAP_HEADER_SIZE ((sizeof(memflex_heap_t) + 7) & ~(size_t)7)
+#define SEGMENT_HEADER_SIZE ((sizeof(heap_segment_t) + 7) & ~(size_t)7)
+
+#define OOB_CHUNK 16 /* Allocation granule of metadata-separated heaps */
+
+#define BLOCK_PAYLOAD(block) ((void *)((char *)(block) + BLOCK_HEADER_SIZE))
+#define PAYLOAD_BLOCK(ptr) ((block_header_t *)((char *)(ptr) - BLOCK_HEADER_SIZE))
+
+/* Block links are offsets from heap->base, so a shared heap works wherever it is
+ * mapped; private heaps use base 0, which makes the links plain addresses. */
+static inline block_header_t *block_at(const memflex_heap_t *heap, uintptr_t link)
+{
+    return link ? (block_header_t *)(heap->base + link) : NULL;
+}
+
+static inline uintptr_t block_link(const memflex_heap_t *heap, const block_header_t *block)
+{
+    return block ? (uintptr_t)block - heap->base : 0;
+}
+
+static inline block_header_t *block_next(const memflex_heap_t *heap, const block_header_t *block)
+{
+    return block_at(heap, block->next);
+}
+
+static inline block_header_t *block_prev(const memflex_heap_t *heap, const block_header_t *block)
+{
+    return block_at(heap, block->prev);
+}
+
+static inline void block_set_next(const memflex_heap_t *heap, block_header_t *block, block_header_t *next)
+{
+    block->next = block_link(heap, next);
+}
+
+static inline void block_set_prev(const memflex_heap_t *heap, block_header_t *block, block_header_t *prev)
+{
+    block->prev = block_link(heap, prev);
+}
+
+static inline void heap_lock(memflex_heap_t *heap)
+{
+    // A holder that died mid-operation leaves the lock usable; the heap is taken as is
+    if (heap->lock && pthread_mutex_lock(heap->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(heap->lock);
+}
+
+static inline void heap_unlock(memflex_heap_t *heap)
+{
+    if (heap->lock)
+        pthread_mutex_unlock(heap->lock);
+}
+
+/* Shared helpers from memory.c */
+size_t mf_page_align(size_t size);
+block_header_t *mf_init_free_block(void *mem, size_t size);
+int mf_blocks_adjacent(block_header_t *a, block_header_t *b);
+void mf_split_block(memflex_heap_t *heap, block_header_t *block, size_t size);
+void mf_absorb_next(memflex_heap_t *heap, block_header_t *block);
+block_header_t *mf_coalesce(memflex_heap_t *heap, block_header_t *block);
+
+/* Handle table teardown from compact.c */
+void mf_release_handles(memflex_heap_t *heap);
+
+/* Detach a shared heap, from shm.c */
+void mf_shared_close(memflex_heap_t *heap);
+
+/* Free-block index hooks, from free_index.c; they feed the TLSF lists when the
+ * heap has them and are no-ops without either TLSF or HEAP_FLAG_FREE_INDEX */
+void mf_index_insert(memflex_heap_t *heap, block_header_t *block);
+void mf_index_remove(memflex_heap_t *heap, block_header_t *block);
+void mf_index_update(memflex_heap_t *heap, block_header_t *block);
+block_header_t *mf_index_find(memflex_heap_t *heap, size_t size, alloc_algo_t algo);
+void mf_index_release(memflex_heap_t *heap);
+
+/* Two-level segregated fit, from tlsf.c */
+int mf_tlsf_enable(memflex_heap_t *heap);
+void mf_tlsf_release(memflex_heap_t *heap);
+void mf_tlsf_insert(memflex_heap_t *heap, block_header_t *block);
+void mf_tlsf_remove(memflex_heap_t *heap, block_header_t *block);
+block_header_t *mf_tlsf_find(memflex_heap_t *heap, size_t size);
+
+/* Buddy allocator, from buddy.c; the region is a block taken from the heap */
+size_t mf_buddy_region_size(memflex_heap_t *heap);
+int mf_buddy_init(memflex_heap_t *heap, void *region);
+void mf_buddy_release(memflex_heap_t *heap);
+int mf_buddy_owns(memflex_heap_t *heap, void *ptr);
+void *mf_buddy_malloc(memflex_heap_t *heap, size_t size);
+void mf_buddy_free(memflex_heap_t *heap, void *ptr);
+void *mf_buddy_realloc(memflex_heap_t *heap, void *ptr, size_t size);
+size_t mf_buddy_usable_size(memflex_heap_t *heap, void *ptr);
+size_t mf_buddy_free_bytes(memflex_heap_t *heap, size_t *largest);
+
+/* Metadata-separated heaps, from oob.c */
+int mf_oob_init(memflex_heap_t *heap, void *mem, size_t size);
+void *mf_oob_malloc(memflex_heap_t *heap, size_t size, alloc_algo_t algo);
+void mf_oob_free(memflex_heap_t *heap, void *ptr);
+void *mf_oob_realloc(memflex_heap_t *heap, void *ptr, size_t size);
+int mf_oob_block_count(memflex_heap_t *heap);
+size_t mf_oob_free_bytes(memflex_heap_t *heap, size_t *largest);
+void mf_oob_prefault(memflex_heap_t *heap);
+size_t mf_oob_usable_size(memflex_heap_t *heap, void *ptr);
+void mf_oob_print(memflex_heap_t *heap, void *highlight_ptr);
+
+/* Sampling profiler, from profile.c. The hooks are forced inline so the
+ * backtrace skip count holds; they cost a decrement and two compares until a
+ * sample is due, and a filter load on free while samples are tracked. A
+ * thread whose session number is stale redraws its countdown at once, so a
+ * restart with a shorter interval takes effect on the next allocation. */
+extern uint32_t mf_profile_session;       /* Current session while sampling, 0 when stopped */
+extern __thread uint32_t mf_profile_thread_session; /* Session this thread's countdown was drawn in */
+extern __thread int64_t mf_profile_countdown; /* Bytes left before this thread's next sample */
+extern uint32_t mf_profile_tracked;       /* Sampled objects not freed yet */
+void mf_profile_sample(void *ptr, size_t size);
+void mf_profile_forget(void *ptr);
+void mf_profile_forget_range(void *start, void *end); /* Heap teardown: retire every sample in [start, end) */
+void mf_profile_move(void *from, void *to);
+
+static inline __attribute__((always_inline)) void mf_profile_alloc(void *ptr, size_t size)
+{
+    uint32_t session = __atomic_load_n(&mf_profile_session, __ATOMIC_RELAXED);
+    if (ptr && session && ((mf_profile_countdown -= (int64_t)size) < 0 || mf_profile_thread_session != session))
+        mf_profile_sample(ptr, size);
+}
+
+static inline __attribute__((always_inline)) void mf_profile_free(void *ptr)
+{
+    if (__atomic_load_n(&mf_profile_tracked, __ATOMIC_RELAXED))
+        mf_profile_forget(ptr);
+}
+
+#endif
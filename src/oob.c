@@ -0,0 +1,265 @@
+#define _GNU_SOURCE
+#include "memory_internal.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Metadata-separated heaps. The arena is cut into OOB_CHUNK-byte chunks and
+ * meta[i] describes the block starting at chunk i: its length in chunks
+ * shifted left by one, with bit 0 set while it is free. The block's last
+ * chunk carries the same value as a footer so free() can find the previous
+ * block. Entries inside a block are stale and never read. Payloads carry no
+ * header, so list walks only touch the side table.
+ */
+
+#define OOB_FREE 1u
+#define OOB_LEN(entry) ((entry) >> 1)
+#define OOB_ENTRY(len, is_free) (((uint32_t)(len) << 1) | ((is_free) ? OOB_FREE : 0))
+
+static void set_block(memflex_heap_t *heap, size_t idx, size_t len, int is_free)
+{
+    uint32_t entry = OOB_ENTRY(len, is_free);
+    heap->meta[idx] = entry;
+    heap->meta[idx + len - 1] = entry;
+}
+
+static void *chunk_ptr(memflex_heap_t *heap, size_t idx)
+{
+    return heap->arena + idx * OOB_CHUNK;
+}
+
+/* Chunk index of a payload, or (size_t)-1 if ptr is not a live block of this heap */
+static size_t chunk_index(memflex_heap_t *heap, void *ptr)
+{
+    uintptr_t off = (uintptr_t)ptr - (uintptr_t)heap->arena;
+    if ((char *)ptr < heap->arena || off % OOB_CHUNK != 0 || off / OOB_CHUNK >= heap->nchunks)
+        return (size_t)-1;
+
+    size_t idx = off / OOB_CHUNK;
+    uint32_t entry = heap->meta[idx];
+    if (entry == 0 || (entry & OOB_FREE))
+        return (size_t)-1;
+    return idx;
+}
+
+int mf_oob_init(memflex_heap_t *heap, void *mem, size_t size)
+{
+    // Each chunk costs OOB_CHUNK arena bytes plus one table entry
+    uintptr_t table = ((uintptr_t)mem + 3) & ~(uintptr_t)3;
+    size_t avail = size - (table - (uintptr_t)mem);
+    size_t nchunks = avail / (OOB_CHUNK + sizeof(uint32_t));
+    if (nchunks < 2)
+        return -1;
+
+    uintptr_t arena = (table + nchunks * sizeof(uint32_t) + OOB_CHUNK - 1) & ~(uintptr_t)(OOB_CHUNK - 1);
+    while (arena + nchunks * OOB_CHUNK > (uintptr_t)mem + size)
+        nchunks--;
+    if (nchunks > (UINT32_MAX >> 1))
+        nchunks = UINT32_MAX >> 1;
+
+    heap->meta = (uint32_t *)table;
+    heap->arena = (char *)arena;
+    heap->nchunks = nchunks;
+    memset(heap->meta, 0, nchunks * sizeof(uint32_t));
+    set_block(heap, 0, nchunks, 1);
+    return 0;
+}
+
+static size_t find_free_run(memflex_heap_t *heap, size_t len, alloc_algo_t algo)
+{
+    const uint32_t *meta = heap->meta;
+    size_t best = (size_t)-1;
+    size_t best_len = 0;
+
+    for (size_t i = 0; i < heap->nchunks; i += OOB_LEN(meta[i]))
+    {
+        uint32_t entry = meta[i];
+        size_t run = OOB_LEN(entry);
+        if (!(entry & OOB_FREE) || run < len)
+            continue;
+
+        if (algo == ALGO_FIRST_FIT)
+            return i;
+        if (best == (size_t)-1 || (algo == ALGO_BEST_FIT ? run < best_len : run > best_len))
+        {
+            best = i;
+            best_len = run;
+        }
+    }
+    return best;
+}
+
+/* Mark [idx, idx + len) used, leaving any rest of the free run after it */
+static void take_run(memflex_heap_t *heap, size_t idx, size_t len)
+{
+    size_t run = OOB_LEN(heap->meta[idx]);
+    if (run > len)
+        set_block(heap, idx + len, run - len, 1);
+    set_block(heap, idx, len, 0);
+}
+
+static size_t chunks_for(size_t size)
+{
+    return (size + OOB_CHUNK - 1) / OOB_CHUNK;
+}
+
+void *mf_oob_malloc(memflex_heap_t *heap, size_t size, alloc_algo_t algo)
+{
+    if (size == 0)
+        return NULL;
+
+    // No segregated lists here: TLSF's good fit is approximated by best fit
+    size_t len = chunks_for(size);
+    size_t idx = find_free_run(heap, len, algo == ALGO_TLSF ? ALGO_BEST_FIT : algo);
+    if (idx == (size_t)-1)
+        return NULL;
+
+    take_run(heap, idx, len);
+    return chunk_ptr(heap, idx);
+}
+
+void mf_oob_free(memflex_heap_t *heap, void *ptr)
+{
+    size_t idx = chunk_index(heap, ptr);
+    if (idx == (size_t)-1)
+        return;
+
+    size_t len = OOB_LEN(heap->meta[idx]);
+    size_t next = idx + len;
+    if (next < heap->nchunks && (heap->meta[next] & OOB_FREE))
+        len += OOB_LEN(heap->meta[next]);
+
+    if (idx > 0 && (heap->meta[idx - 1] & OOB_FREE))
+    {
+        size_t prev_len = OOB_LEN(heap->meta[idx - 1]);
+        idx -= prev_len;
+        len += prev_len;
+    }
+
+    set_block(heap, idx, len, 1);
+}
+
+void *mf_oob_realloc(memflex_heap_t *heap, void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return mf_oob_malloc(heap, size, ALGO_FIRST_FIT);
+    if (size == 0)
+    {
+        mf_oob_free(heap, ptr);
+        return NULL;
+    }
+
+    size_t idx = chunk_index(heap, ptr);
+    if (idx == (size_t)-1)
+        return NULL;
+
+    size_t old_len = OOB_LEN(heap->meta[idx]);
+    size_t len = chunks_for(size);
+    size_t next = idx + old_len;
+
+    // Shrinking: give the tail back (merging it with a free neighbour)
+    if (len <= old_len)
+    {
+        if (len < old_len)
+        {
+            size_t rest = old_len - len;
+            if (next < heap->nchunks && (heap->meta[next] & OOB_FREE))
+                rest += OOB_LEN(heap->meta[next]);
+            set_block(heap, idx + len, rest, 1);
+            set_block(heap, idx, len, 0);
+        }
+        return ptr;
+    }
+
+    // Growing in place into a free neighbour
+    if (next < heap->nchunks && (heap->meta[next] & OOB_FREE) && old_len + OOB_LEN(heap->meta[next]) >= len)
+    {
+        size_t total = old_len + OOB_LEN(heap->meta[next]);
+        if (total > len)
+            set_block(heap, idx + len, total - len, 1);
+        set_block(heap, idx, len, 0);
+        return ptr;
+    }
+
+    void *new_ptr = mf_oob_malloc(heap, size, ALGO_FIRST_FIT);
+    if (new_ptr)
+    {
+        memcpy(new_ptr, ptr, old_len * OOB_CHUNK);
+        mf_oob_free(heap, ptr);
+    }
+    return new_ptr;
+}
+
+int mf_oob_block_count(memflex_heap_t *heap)
+{
+    int count = 0;
+    for (size_t i = 0; i < heap->nchunks; i += OOB_LEN(heap->meta[i]))
+    {
+        count++;
+    }
+    return count;
+}
+
+size_t mf_oob_usable_size(memflex_heap_t *heap, void *ptr)
+{
+    size_t idx = chunk_index(heap, ptr);
+    return idx == (size_t)-1 ? 0 : (size_t)OOB_LEN(heap->meta[idx]) * OOB_CHUNK;
+}
+
+size_t mf_oob_free_bytes(memflex_heap_t *heap, size_t *largest)
+{
+    size_t total = 0;
+    if (largest)
+        *largest = 0;
+
+    for (size_t i = 0; i < heap->nchunks; i += OOB_LEN(heap->meta[i]))
+    {
+        if (!(heap->meta[i] & OOB_FREE))
+            continue;
+
+        size_t bytes = OOB_LEN(heap->meta[i]) * OOB_CHUNK;
+        total += bytes;
+        if (largest && bytes > *largest)
+            *largest = bytes;
+    }
+    return total;
+}
+
+void mf_oob_prefault(memflex_heap_t *heap)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < heap->nchunks; i += OOB_LEN(heap->meta[i]))
+    {
+        if (!(heap->meta[i] & OOB_FREE))
+            continue;
+
+        volatile char *p = chunk_ptr(heap, i);
+        size_t bytes = OOB_LEN(heap->meta[i]) * OOB_CHUNK;
+        for (size_t off = 0; off < bytes; off += page)
+        {
+            p[off] = p[off];
+        }
+    }
+}
+
+void mf_oob_print(memflex_heap_t *heap, void *highlight_ptr)
+{
+    int n = 0;
+    for (size_t i = 0; i < heap->nchunks; i += OOB_LEN(heap->meta[i]))
+    {
+        void *data_ptr = chunk_ptr(heap, i);
+        int highlight = (highlight_ptr != NULL && data_ptr == highlight_ptr);
+
+        if (highlight)
+            printf("----------------------------------------\n");
+        printf("Block %d: [%s] Size: %zu bytes (Addr: %p)\n",
+               n++,
+               (heap->meta[i] & OOB_FREE) ? "FREE" : "USED",
+               (size_t)OOB_LEN(heap->meta[i]) * OOB_CHUNK,
+               data_ptr);
+        if (highlight)
+            printf("----------------------------------------\n");
+    }
+    printf("Total Blocks: %d\n", n);
+}
@@ -0,0 +1,470 @@
+#define _GNU_SOURCE
+#include "memory_internal.h"
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+/*
+ * Sampling heap profiler. Every thread counts allocated bytes down from a
+ * distance drawn from an exponential distribution with mean
+ * sample_interval, so each byte is equally likely to be sampled whatever
+ * the allocation sizes. Only a sampled allocation pays for a backtrace and a
+ * table insert. Samples stay in the object table until freed, which gives
+ * live bytes per call site; frees consult a counting filter without the lock
+ * and only take it on a hit.
+ */
+
+#define PROFILE_MAX_DEPTH 32
+#define PROFILE_SKIP 2 /* mf_profile_sample and the heap_* entry point */
+#define PROFILE_TABLE_MIN 256
+#define FILTER_BITS 16
+
+/* One allocation stack; sites are never removed so cumulative counts survive frees */
+typedef struct profile_site
+{
+    uint64_t hash;
+    uint32_t depth;
+    void *pcs[PROFILE_MAX_DEPTH];
+    uint64_t live_objs;      /* Sampled objects not freed yet */
+    uint64_t live_bytes;     /* Their requested bytes */
+    uint64_t alloc_objs;     /* All samples taken here */
+    uint64_t alloc_bytes;
+    uint64_t live_estimate;  /* Unsampled estimates of live_bytes and alloc_bytes */
+    uint64_t alloc_estimate;
+} profile_site_t;
+
+/* A sampled allocation that has not been freed */
+typedef struct profile_object
+{
+    void *ptr;         /* Payload, NULL if the slot is empty */
+    size_t size;       /* Requested size */
+    uint64_t estimate; /* Bytes this sample stands for */
+    uint32_t site;     /* Index into sites */
+} profile_object_t;
+
+uint32_t mf_profile_session;
+__thread uint32_t mf_profile_thread_session;
+__thread int64_t mf_profile_countdown;
+uint32_t mf_profile_tracked;
+
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t samples_taken; /* Since heap_profile_start */
+static size_t sample_interval; /* Mean bytes between samples; kept after stop for the dumps */
+static uint32_t last_session;
+static __thread uint64_t rng_state;
+
+static profile_site_t *sites; /* Append-only, so indices stay valid when it grows */
+static uint32_t site_count;
+static uint32_t site_cap;
+static uint32_t *site_index; /* Open addressing over stack hashes: site + 1, 0 if empty */
+static uint32_t index_cap;
+static profile_object_t *objects; /* Open addressing over payload addresses */
+static uint32_t object_cap;
+static uint16_t filter[1u << FILTER_BITS]; /* Tracked objects per address bucket */
+
+static uint64_t hash_ptr(const void *ptr)
+{
+    return ((uintptr_t)ptr >> 3) * 0x9E3779B97F4A7C15ull;
+}
+
+static uint32_t filter_slot(const void *ptr)
+{
+    return (uint32_t)(hash_ptr(ptr) >> (64 - FILTER_BITS));
+}
+
+static uint32_t object_home(const void *ptr, uint32_t mask)
+{
+    return (uint32_t)(hash_ptr(ptr) >> 32) & mask;
+}
+
+/* Exponentially distributed distance to the next sample */
+static int64_t next_distance(void)
+{
+    if (rng_state == 0)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        rng_state = hash_ptr(&rng_state) ^ (uint64_t)ts.tv_nsec ^ 1;
+    }
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+
+    // u in (0, 1], so the log is finite
+    double u = (double)(((rng_state * 0x2545F4914F6CDD1Dull) >> 11) + 1) * 0x1.0p-53;
+    return (int64_t)(-log(u) * (double)sample_interval);
+}
+
+static void *map_table(size_t bytes)
+{
+    void *mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+}
+
+static void release_tables(void)
+{
+    if (sites)
+        munmap(sites, (size_t)site_cap * sizeof(profile_site_t));
+    if (site_index)
+        munmap(site_index, (size_t)index_cap * sizeof(uint32_t));
+    if (objects)
+        munmap(objects, (size_t)object_cap * sizeof(profile_object_t));
+    sites = NULL;
+    site_count = 0;
+    site_cap = 0;
+    site_index = NULL;
+    index_cap = 0;
+    objects = NULL;
+    object_cap = 0;
+    memset(filter, 0, sizeof(filter));
+    __atomic_store_n(&mf_profile_tracked, 0, __ATOMIC_RELAXED);
+}
+
+static uint32_t index_slot(uint32_t *index, uint32_t cap, uint64_t hash)
+{
+    uint32_t i = (uint32_t)hash & (cap - 1);
+    while (index[i] != 0 && sites[index[i] - 1].hash != hash)
+    {
+        i = (i + 1) & (cap - 1);
+    }
+    return i;
+}
+
+static int grow_sites(void)
+{
+    uint32_t new_cap = site_cap ? site_cap * 2 : PROFILE_TABLE_MIN;
+    profile_site_t *table;
+    if (sites)
+        table = mremap(sites, (size_t)site_cap * sizeof(profile_site_t), (size_t)new_cap * sizeof(profile_site_t), MREMAP_MAYMOVE);
+    else
+        table = mmap(NULL, (size_t)new_cap * sizeof(profile_site_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED)
+        return -1;
+    sites = table;
+    site_cap = new_cap;
+
+    // Keep the index at most half full
+    uint32_t *index = map_table((size_t)new_cap * 2 * sizeof(uint32_t));
+    if (!index)
+        return -1;
+    for (uint32_t i = 0; i < site_count; i++)
+    {
+        index[index_slot(index, new_cap * 2, sites[i].hash)] = i + 1;
+    }
+    if (site_index)
+        munmap(site_index, (size_t)index_cap * sizeof(uint32_t));
+    site_index = index;
+    index_cap = new_cap * 2;
+    return 0;
+}
+
+static uint32_t object_slot(const void *ptr)
+{
+    uint32_t mask = object_cap - 1;
+    uint32_t i = object_home(ptr, mask);
+    while (objects[i].ptr != NULL && objects[i].ptr != ptr)
+    {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int grow_objects(void)
+{
+    profile_object_t *old = objects;
+    uint32_t old_cap = object_cap;
+    uint32_t new_cap = old_cap ? old_cap * 2 : PROFILE_TABLE_MIN;
+    profile_object_t *table = map_table((size_t)new_cap * sizeof(profile_object_t));
+    if (!table)
+        return -1;
+
+    objects = table;
+    object_cap = new_cap;
+    for (uint32_t i = 0; i < old_cap; i++)
+    {
+        if (old[i].ptr)
+            objects[object_slot(old[i].ptr)] = old[i];
+    }
+    if (old)
+        munmap(old, (size_t)old_cap * sizeof(profile_object_t));
+    return 0;
+}
+
+/* Backward-shift deletion keeps probe chains intact without tombstones */
+static void remove_object(uint32_t hole)
+{
+    uint32_t mask = object_cap - 1;
+    for (uint32_t j = (hole + 1) & mask; objects[j].ptr != NULL; j = (j + 1) & mask)
+    {
+        // j may fill the hole unless its home slot lies cyclically in (hole, j]
+        uint32_t home = object_home(objects[j].ptr, mask);
+        if (((j - home) & mask) >= ((j - hole) & mask))
+        {
+            objects[hole] = objects[j];
+            hole = j;
+        }
+    }
+    objects[hole].ptr = NULL;
+}
+
+static void track(void *ptr, size_t size, uint64_t estimate, uint32_t site)
+{
+    profile_object_t *obj = &objects[object_slot(ptr)];
+    obj->ptr = ptr;
+    obj->size = size;
+    obj->estimate = estimate;
+    obj->site = site;
+    __atomic_add_fetch(&filter[filter_slot(ptr)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mf_profile_tracked, 1, __ATOMIC_RELAXED);
+}
+
+/* Drop ptr from the object table into *out; -1 if it was not sampled */
+static int untrack(void *ptr, profile_object_t *out)
+{
+    if (object_cap == 0)
+        return -1;
+
+    uint32_t slot = object_slot(ptr);
+    if (objects[slot].ptr == NULL)
+        return -1;
+
+    *out = objects[slot];
+    remove_object(slot);
+    __atomic_sub_fetch(&filter[filter_slot(ptr)], 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&mf_profile_tracked, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static uint32_t intern_site(void **pcs, int depth)
+{
+    uint64_t hash = 1469598103934665603ull;
+    for (int i = 0; i < depth; i++)
+    {
+        hash = (hash ^ (uintptr_t)pcs[i]) * 1099511628211ull;
+    }
+
+    uint32_t slot = index_slot(site_index, index_cap, hash);
+    if (site_index[slot] == 0)
+    {
+        profile_site_t *s = &sites[site_count];
+        memset(s, 0, sizeof(*s));
+        s->hash = hash;
+        s->depth = (uint32_t)depth;
+        memcpy(s->pcs, pcs, (size_t)depth * sizeof(void *));
+        site_index[slot] = ++site_count;
+    }
+    return site_index[slot] - 1;
+}
+
+__attribute__((noinline)) void mf_profile_sample(void *ptr, size_t size)
+{
+    // Acquire pairs with heap_profile_start so sample_interval is the session's
+    uint32_t session = __atomic_load_n(&mf_profile_session, __ATOMIC_ACQUIRE);
+    if (session == 0)
+        return;
+    if (mf_profile_thread_session != session)
+    {
+        // First allocation of this thread in the current session: drop the old countdown
+        mf_profile_thread_session = session;
+        mf_profile_countdown = next_distance() - (int64_t)size;
+        if (mf_profile_countdown >= 0)
+            return;
+    }
+    mf_profile_countdown = next_distance();
+
+    void *frames[PROFILE_MAX_DEPTH + PROFILE_SKIP];
+    int depth = backtrace(frames, PROFILE_MAX_DEPTH + PROFILE_SKIP) - PROFILE_SKIP;
+    if (depth < 0)
+        depth = 0;
+
+    // A sample stands for 1 / P(sampled) allocations of its size
+    double interval = (double)sample_interval;
+    uint64_t estimate = (uint64_t)((double)size / (1.0 - exp(-(double)size / interval)) + 0.5);
+
+    pthread_mutex_lock(&profile_lock);
+    if (site_count == site_cap && grow_sites() != 0)
+        goto out;
+    if ((mf_profile_tracked + 1) * 2 > object_cap && grow_objects() != 0)
+        goto out;
+
+    uint32_t site = intern_site(frames + PROFILE_SKIP, depth);
+    profile_site_t *s = &sites[site];
+    s->live_objs++;
+    s->live_bytes += size;
+    s->alloc_objs++;
+    s->alloc_bytes += size;
+    s->live_estimate += estimate;
+    s->alloc_estimate += estimate;
+    track(ptr, size, estimate, site);
+    samples_taken++;
+out:
+    pthread_mutex_unlock(&profile_lock);
+}
+
+void mf_profile_forget(void *ptr)
+{
+    if (__atomic_load_n(&filter[filter_slot(ptr)], __ATOMIC_RELAXED) == 0)
+        return;
+
+    profile_object_t obj;
+    pthread_mutex_lock(&profile_lock);
+    if (untrack(ptr, &obj) >= 0)
+    {
+        profile_site_t *s = &sites[obj.site];
+        s->live_objs--;
+        s->live_bytes -= obj.size;
+        s->live_estimate -= obj.estimate;
+    }
+    pthread_mutex_unlock(&profile_lock);
+}
+
+void mf_profile_forget_range(void *start, void *end)
+{
+    if (__atomic_load_n(&mf_profile_tracked, __ATOMIC_RELAXED) == 0)
+        return;
+
+    pthread_mutex_lock(&profile_lock);
+    for (uint32_t i = 0; i < object_cap; i++)
+    {
+        // Removal shifts a later object into slot i, so look at it again
+        profile_object_t obj;
+        while (objects[i].ptr && (char *)objects[i].ptr >= (char *)start && (char *)objects[i].ptr < (char *)end &&
+               untrack(objects[i].ptr, &obj) == 0)
+        {
+            profile_site_t *s = &sites[obj.site];
+            s->live_objs--;
+            s->live_bytes -= obj.size;
+            s->live_estimate -= obj.estimate;
+        }
+    }
+    pthread_mutex_unlock(&profile_lock);
+}
+
+void mf_profile_move(void *from, void *to)
+{
+    if (__atomic_load_n(&filter[filter_slot(from)], __ATOMIC_RELAXED) == 0)
+        return;
+
+    profile_object_t obj;
+    pthread_mutex_lock(&profile_lock);
+    if (untrack(from, &obj) >= 0)
+        track(to, obj.size, obj.estimate, obj.site);
+    pthread_mutex_unlock(&profile_lock);
+}
+
+void heap_profile_start(size_t sample_bytes)
+{
+    // Let the unwinder load its libraries now rather than inside the first sample
+    void *warm[1];
+    backtrace(warm, 1);
+
+    pthread_mutex_lock(&profile_lock);
+    release_tables();
+    sample_interval = sample_bytes ? sample_bytes : HEAP_PROFILE_DEFAULT_INTERVAL;
+    samples_taken = 0;
+    if (++last_session == 0)
+        last_session = 1;
+    __atomic_store_n(&mf_profile_session, last_session, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&profile_lock);
+}
+
+void heap_profile_stop(void)
+{
+    // Tracked samples are still retired by frees, so live numbers stay right for dumps
+    __atomic_store_n(&mf_profile_session, 0, __ATOMIC_RELAXED);
+}
+
+size_t heap_profile_samples(void)
+{
+    pthread_mutex_lock(&profile_lock);
+    size_t n = samples_taken;
+    pthread_mutex_unlock(&profile_lock);
+    return n;
+}
+
+/* pprof's legacy heap format; the heap_v2 period lets pprof unsample the raw counts */
+static void dump_pprof(FILE *fp)
+{
+    uint64_t live_objs = 0, live_bytes = 0, alloc_objs = 0, alloc_bytes = 0;
+    for (uint32_t i = 0; i < site_count; i++)
+    {
+        live_objs += sites[i].live_objs;
+        live_bytes += sites[i].live_bytes;
+        alloc_objs += sites[i].alloc_objs;
+        alloc_bytes += sites[i].alloc_bytes;
+    }
+
+    fprintf(fp, "heap profile: %llu: %llu [%llu: %llu] @ heap_v2/%zu\n",
+            (unsigned long long)live_objs, (unsigned long long)live_bytes,
+            (unsigned long long)alloc_objs, (unsigned long long)alloc_bytes, sample_interval);
+    for (uint32_t i = 0; i < site_count; i++)
+    {
+        profile_site_t *s = &sites[i];
+        fprintf(fp, "%llu: %llu [%llu: %llu] @",
+                (unsigned long long)s->live_objs, (unsigned long long)s->live_bytes,
+                (unsigned long long)s->alloc_objs, (unsigned long long)s->alloc_bytes);
+        for (uint32_t d = 0; d < s->depth; d++)
+        {
+            fprintf(fp, " %p", s->pcs[d]);
+        }
+        fprintf(fp, "\n");
+    }
+
+    // pprof symbolizes against the mappings
+    fprintf(fp, "\nMAPPED_LIBRARIES:\n");
+    FILE *maps = fopen("/proc/self/maps", "r");
+    if (maps)
+    {
+        char line[512];
+        while (fgets(line, sizeof(line), maps))
+        {
+            fputs(line, fp);
+        }
+        fclose(maps);
+    }
+}
+
+/* One "root;...;leaf bytes" line per site, for flamegraph.pl and friends */
+static void dump_folded(FILE *fp, int live)
+{
+    for (uint32_t i = 0; i < site_count; i++)
+    {
+        profile_site_t *s = &sites[i];
+        uint64_t bytes = live ? s->live_estimate : s->alloc_estimate;
+        if (bytes == 0)
+            continue;
+
+        if (s->depth == 0)
+            fprintf(fp, "[unknown] ");
+        for (uint32_t d = s->depth; d-- > 0;)
+        {
+            Dl_info info;
+            if (dladdr(s->pcs[d], &info) && info.dli_sname)
+                fprintf(fp, "%s", info.dli_sname);
+            else
+                fprintf(fp, "%p", s->pcs[d]);
+            fprintf(fp, d ? ";" : " ");
+        }
+        fprintf(fp, "%llu\n", (unsigned long long)bytes);
+    }
+}
+
+int heap_profile_dump(const char *filepath, heap_profile_format_t format)
+{
+    FILE *fp = fopen(filepath, "w");
+    if (!fp)
+        return -1;
+
+    pthread_mutex_lock(&profile_lock);
+    if (format == HEAP_PROFILE_PPROF)
+        dump_pprof(fp);
+    else
+        dump_folded(fp, format == HEAP_PROFILE_FOLDED_LIVE);
+    pthread_mutex_unlock(&profile_lock);
+
+    return fclose(fp) == 0 ? 0 : -1;
+}
@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include "memory_internal.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Start of a shared region; everything in it is position-independent */
+typedef struct shared_header
+{
+    uint32_t magic;       /* SHARED_MAGIC once the region is formatted */
+    uint32_t version;     /* SHARED_VERSION */
+    size_t size;          /* Size of the whole region */
+    uintptr_t start;      /* Offset of the first block */
+    pthread_mutex_t lock; /* Process-shared, robust */
+} shared_header_t;
+
+#define SHARED_MAGIC 0x4D465348u /* "MFSH" */
+#define SHARED_VERSION 1
+#define SHARED_HEADER_SIZE ((sizeof(shared_header_t) + 7) & ~(size_t)7)
+#define ATTACH_RETRIES 1000 /* 1ms apart while another process formats the region */
+
+static int open_backing(const char *name, int flags, int oflag)
+{
+    if (flags & HEAP_SHARED_FILE)
+        return open(name, oflag, 0600);
+    return shm_open(name, oflag, 0600);
+}
+
+static int format_region(shared_header_t *hdr, size_t size)
+{
+    pthread_mutexattr_t attr;
+    if (pthread_mutexattr_init(&attr) != 0)
+        return -1;
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    int rc = pthread_mutex_init(&hdr->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (rc != 0)
+        return -1;
+
+    hdr->version = SHARED_VERSION;
+    hdr->size = size;
+    hdr->start = SHARED_HEADER_SIZE;
+    mf_init_free_block((char *)hdr + SHARED_HEADER_SIZE, size - SHARED_HEADER_SIZE);
+
+    // Publish last: attachers spin on the magic
+    __atomic_store_n(&hdr->magic, SHARED_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Wait for the creator to size the object; returns its size or 0 */
+static size_t wait_for_size(int fd)
+{
+    struct stat st;
+    for (int i = 0; i < ATTACH_RETRIES; i++)
+    {
+        if (fstat(fd, &st) != 0)
+            return 0;
+        if ((size_t)st.st_size >= SHARED_HEADER_SIZE + BLOCK_HEADER_SIZE)
+            return (size_t)st.st_size;
+        usleep(1000);
+    }
+    return 0;
+}
+
+static int wait_for_format(shared_header_t *hdr, size_t size)
+{
+    for (int i = 0; i < ATTACH_RETRIES; i++)
+    {
+        if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) == SHARED_MAGIC)
+            return hdr->version == SHARED_VERSION && hdr->size == size ? 0 : -1;
+        usleep(1000);
+    }
+    return -1;
+}
+
+memflex_heap_t *heap_shared_open(const char *name, size_t size, int flags)
+{
+    if (!name)
+        return NULL;
+
+    int created = 1;
+    int fd = open_backing(name, flags, O_RDWR | O_CREAT | O_EXCL);
+    if (fd < 0 && errno == EEXIST)
+    {
+        created = 0;
+        fd = open_backing(name, flags, O_RDWR);
+    }
+    if (fd < 0)
+        return NULL;
+
+    if (created)
+    {
+        size = mf_page_align(size);
+        if (size < SHARED_HEADER_SIZE + BLOCK_HEADER_SIZE + 8 || ftruncate(fd, size) != 0)
+            goto fail_fd;
+    }
+    else if ((size = wait_for_size(fd)) == 0)
+    {
+        goto fail_fd;
+    }
+
+    shared_header_t *hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED)
+        goto fail_name;
+
+    if (created ? format_region(hdr, size) != 0 : wait_for_format(hdr, size) != 0)
+        goto fail_map;
+
+    // The handle itself is per process and points into this process's mapping
+    memflex_heap_t *heap = mmap(NULL, sizeof(memflex_heap_t), PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (heap == MAP_FAILED)
+        goto fail_map;
+
+    memset(heap, 0, sizeof(*heap));
+    heap->base = (uintptr_t)hdr;
+    heap->start = block_at(heap, hdr->start);
+    heap->total_size = size;
+    heap->backing = HEAP_BACKING_SHARED;
+    heap->region = hdr;
+    heap->region_size = size;
+    heap->lock = &hdr->lock;
+    heap->magic = HEAP_MAGIC;
+    return heap;
+
+fail_map:
+    munmap(hdr, size);
+fail_name:
+    if (created)
+        (flags & HEAP_SHARED_FILE) ? unlink(name) : shm_unlink(name);
+    return NULL;
+fail_fd:
+    close(fd);
+    goto fail_name;
+}
+
+void mf_shared_close(memflex_heap_t *heap)
+{
+    heap->magic = 0;
+    munmap(heap->region, heap->region_size);
+    munmap(heap, sizeof(memflex_heap_t));
+}
+
+size_t heap_ptr_to_offset(memflex_heap_t *heap, void *ptr)
+{
+    if (!heap || !ptr)
+        return 0;
+    return (uintptr_t)ptr - heap->base;
+}
+
+void *heap_offset_to_ptr(memflex_heap_t *heap, size_t offset)
+{
+    if (!heap || offset == 0)
+        return NULL;
+    return (void *)(heap->base + offset);
+}
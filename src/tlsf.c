@@ -0,0 +1,167 @@
+#define _GNU_SOURCE
+#include "memory_internal.h"
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ * Two-level segregated fit (ALGO_TLSF). Free blocks are kept in lists by size
+ * class: the first level is the power of two below the size, the second
+ * splits that range into SL_COUNT equal steps. Sizes under SMALL_SIZE get
+ * 8-byte classes in first level 0. One bit per non-empty list in sl_bitmap,
+ * one bit per non-empty first level in fl_bitmap, so a search is a mask and
+ * a count-trailing-zeros on each. The list links live in the free payload;
+ * block->slot holds the list number + 1 so the block can be unlinked after
+ * its size changed. Blocks too small for the links stay out of the lists.
+ */
+
+#define SL_LOG2 5
+#define SL_COUNT (1u << SL_LOG2)
+#define FL_SHIFT (SL_LOG2 + 3) /* First level 0 covers sizes below 256 in 8-byte steps */
+#define SMALL_SIZE ((size_t)1 << FL_SHIFT)
+#define FL_COUNT (64 - FL_SHIFT + 1)
+
+/* Stored at the start of a free block's payload */
+typedef struct tlsf_links
+{
+    block_header_t *next_free;
+    block_header_t *prev_free;
+} tlsf_links_t;
+
+#define TLSF_MIN_BLOCK sizeof(tlsf_links_t)
+
+struct mf_tlsf
+{
+    uint64_t fl_bitmap;
+    uint32_t sl_bitmap[FL_COUNT];
+    block_header_t *heads[FL_COUNT][SL_COUNT];
+};
+
+static tlsf_links_t *links(block_header_t *block)
+{
+    return (tlsf_links_t *)BLOCK_PAYLOAD(block);
+}
+
+/* List that holds blocks of exactly this size */
+static void mapping_insert(size_t size, unsigned *fl, unsigned *sl)
+{
+    if (size < SMALL_SIZE)
+    {
+        *fl = 0;
+        *sl = (unsigned)(size >> 3);
+        return;
+    }
+    unsigned bit = 63 - (unsigned)__builtin_clzll(size);
+    *sl = (unsigned)(size >> (bit - SL_LOG2)) ^ SL_COUNT;
+    *fl = bit - FL_SHIFT + 1;
+}
+
+/* First list whose every block fits size; returns -1 if size is too big to round up */
+static int mapping_search(size_t size, unsigned *fl, unsigned *sl)
+{
+    if (size >= SMALL_SIZE)
+    {
+        size_t round = ((size_t)1 << (63 - __builtin_clzll(size) - SL_LOG2)) - 1;
+        if (size + round < size)
+            return -1;
+        size += round;
+    }
+    mapping_insert(size, fl, sl);
+    return 0;
+}
+
+void mf_tlsf_insert(memflex_heap_t *heap, block_header_t *block)
+{
+    block->slot = 0;
+    if (block->size < TLSF_MIN_BLOCK)
+        return;
+
+    struct mf_tlsf *t = heap->tlsf;
+    unsigned fl, sl;
+    mapping_insert(block->size, &fl, &sl);
+
+    block_header_t *head = t->heads[fl][sl];
+    links(block)->next_free = head;
+    links(block)->prev_free = NULL;
+    if (head)
+        links(head)->prev_free = block;
+    t->heads[fl][sl] = block;
+    t->fl_bitmap |= 1ull << fl;
+    t->sl_bitmap[fl] |= 1u << sl;
+    block->slot = fl * SL_COUNT + sl + 1;
+}
+
+void mf_tlsf_remove(memflex_heap_t *heap, block_header_t *block)
+{
+    if (block->slot == 0)
+        return;
+
+    struct mf_tlsf *t = heap->tlsf;
+    unsigned fl = (block->slot - 1) / SL_COUNT;
+    unsigned sl = (block->slot - 1) % SL_COUNT;
+    block_header_t *next = links(block)->next_free;
+    block_header_t *prev = links(block)->prev_free;
+
+    if (next)
+        links(next)->prev_free = prev;
+    if (prev)
+        links(prev)->next_free = next;
+    else
+    {
+        t->heads[fl][sl] = next;
+        if (!next)
+        {
+            t->sl_bitmap[fl] &= ~(1u << sl);
+            if (!t->sl_bitmap[fl])
+                t->fl_bitmap &= ~(1ull << fl);
+        }
+    }
+    block->slot = 0;
+}
+
+block_header_t *mf_tlsf_find(memflex_heap_t *heap, size_t size)
+{
+    struct mf_tlsf *t = heap->tlsf;
+    unsigned fl, sl;
+    if (mapping_search(size, &fl, &sl) != 0 || fl >= FL_COUNT)
+        return NULL;
+
+    // Rest of this first level, else the smallest non-empty list of a higher one
+    uint32_t sl_map = t->sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map)
+    {
+        uint64_t fl_map = fl + 1 < 64 ? t->fl_bitmap & (~0ull << (fl + 1)) : 0;
+        if (!fl_map)
+            return NULL;
+        fl = (unsigned)__builtin_ctzll(fl_map);
+        sl_map = t->sl_bitmap[fl];
+    }
+    return t->heads[fl][__builtin_ctz(sl_map)];
+}
+
+int mf_tlsf_enable(memflex_heap_t *heap)
+{
+    // The lists hold process-local pointers, so shared heaps keep walking the block list;
+    // block->slot already belongs to the packed size index on indexed heaps
+    if (heap->backing == HEAP_BACKING_SHARED || (heap->flags & HEAP_FLAG_FREE_INDEX))
+        return -1;
+
+    struct mf_tlsf *t = mmap(NULL, sizeof(struct mf_tlsf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (t == MAP_FAILED)
+        return -1;
+
+    heap->tlsf = t;
+
+    for (block_header_t *b = heap->start; b != NULL; b = block_next(heap, b))
+    {
+        if (b->is_free)
+            mf_tlsf_insert(heap, b);
+    }
+    return 0;
+}
+
+void mf_tlsf_release(memflex_heap_t *heap)
+{
+    if (heap->tlsf)
+        munmap(heap->tlsf, sizeof(struct mf_tlsf));
+    heap->tlsf = NULL;
+}
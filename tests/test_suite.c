@@ -1,5 +1,9 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include "../src/memory.h"
 #include "test_utils.h"
 
@@ -59,6 +63,14 @@ void test_calloc()
     ASSERT(is_zero, "Memory should be zero-initialized");
 
     my_free(arr);
+
+    // num * size wraps around to 16 here
+    size_t huge = SIZE_MAX / 16 + 2;
+    ASSERT_NULL(my_calloc(huge, 16, ALGO_FIRST_FIT), "Calloc should fail when num * size overflows");
+    static char buffer[1024];
+    memflex_heap_t *heap = heap_create(HEAP_BACKING_BUFFER, buffer, sizeof(buffer));
+    ASSERT_NULL(heap_calloc(heap, huge, 16, ALGO_FIRST_FIT), "heap_calloc should fail when num * size overflows");
+    heap_destroy(heap);
 }
 
 void test_realloc()
@@ -104,6 +116,633 @@ void test_realloc()
     ASSERT_NULL(p4, "realloc(ptr, 0) should return NULL (freed)");
 }
 
+void test_heap_instances()
+{
+    printf("\n--- Testing heap instances ---\n");
+    static char buffer[4096];
+
+    memflex_heap_t *h_buf = heap_create(HEAP_BACKING_BUFFER, buffer, sizeof(buffer));
+    ASSERT_NOT_NULL(h_buf, "Buffer-backed heap should be created");
+
+    memflex_heap_t *h_map = heap_create(HEAP_BACKING_MMAP, NULL, 8192);
+    ASSERT_NOT_NULL(h_map, "mmap-backed heap should be created");
+
+    void *a = heap_malloc(h_buf, 128, ALGO_FIRST_FIT);
+    void *b = heap_malloc(h_map, 128, ALGO_FIRST_FIT);
+    ASSERT_NOT_NULL(a, "Allocation from buffer heap should succeed");
+    ASSERT_NOT_NULL(b, "Allocation from mmap heap should succeed");
+    ASSERT((char *)a >= buffer && (char *)a < buffer + sizeof(buffer), "Buffer heap should allocate inside its buffer");
+
+    void *big = heap_malloc(h_buf, 8192, ALGO_FIRST_FIT);
+    ASSERT_NULL(big, "Buffer heap should not grow past its buffer");
+
+    void *grown = heap_malloc(h_map, 64 * 1024, ALGO_BEST_FIT);
+    ASSERT_NOT_NULL(grown, "mmap heap should grow with a new mapping");
+    memset(grown, 0x5A, 64 * 1024);
+
+    int blocks = heap_get_block_count(h_buf);
+    heap_free(h_buf, a);
+    ASSERT(heap_get_block_count(h_buf) < blocks, "Freeing should coalesce within the instance");
+
+    void *d = my_malloc(64, ALGO_FIRST_FIT);
+    ASSERT_NOT_NULL(d, "Default instance should be unaffected by other heaps");
+    my_free(d);
+
+    heap_destroy(h_map);
+    heap_destroy(h_buf);
+    ASSERT_NULL(heap_malloc(h_buf, 16, ALGO_FIRST_FIT), "Destroyed heap should refuse allocations");
+}
+
+void test_compaction()
+{
+    printf("\n--- Testing handles and compaction ---\n");
+    memflex_heap_t *heap = heap_create(HEAP_BACKING_MMAP, NULL, 64 * 1024);
+    ASSERT_NOT_NULL(heap, "mmap-backed heap should be created");
+
+    memflex_handle_t handles[64];
+    for (int i = 0; i < 64; i++)
+    {
+        handles[i] = heap_halloc(heap, 200);
+        ASSERT(handles[i] != 0, "Handle allocation should succeed");
+        unsigned char *p = heap_pin(heap, handles[i]);
+        memset(p, i, 200);
+        heap_unpin(heap, handles[i]);
+    }
+
+    for (int i = 0; i < 64; i += 2)
+    {
+        heap_hfree(heap, handles[i]);
+    }
+    ASSERT(heap_get_block_count(heap) > 64, "Freeing every other block should leave holes");
+
+    void *pinned = heap_pin(heap, handles[33]);
+
+    while (!heap_compact(heap, 1))
+    {
+    }
+
+    ASSERT(heap_pin(heap, handles[33]) == pinned, "Pinned block should not move");
+    heap_unpin(heap, handles[33]);
+    heap_unpin(heap, handles[33]);
+
+    int intact = 1;
+    for (int i = 1; i < 64; i += 2)
+    {
+        unsigned char *p = heap_pin(heap, handles[i]);
+        for (int j = 0; j < 200; j++)
+        {
+            if (p[j] != (unsigned char)i)
+                intact = 0;
+        }
+        heap_unpin(heap, handles[i]);
+    }
+    ASSERT(intact, "Data should survive relocation");
+
+    ASSERT(heap_compact(heap, 0), "Unlimited compaction should finish in one call");
+    ASSERT(heap_get_block_count(heap) <= 32 + 3, "Holes should be gathered around the pinned block");
+    ASSERT(heap_trim(heap) > 0, "Trimming should release the free tail");
+
+    heap_destroy(heap);
+
+    // sbrk heap whose free tail is a separate extension starting on a page boundary
+    heap = heap_create(HEAP_BACKING_SBRK, NULL, 512);
+    long page = sysconf(_SC_PAGESIZE);
+    char *brk = sbrk(0);
+    sbrk((page - (uintptr_t)brk % page) % page);
+    void *big = heap_malloc(heap, 8 * page, ALGO_TLSF);
+    ASSERT_NOT_NULL(big, "sbrk heap should grow");
+    heap_free(heap, big);
+    ASSERT(heap_trim(heap) > 0, "Trimming should hand a page-aligned extension back");
+    ASSERT_NOT_NULL(heap_malloc(heap, 64, ALGO_TLSF), "Heap should stay usable after trimming");
+}
+
+void test_shared_heap()
+{
+    printf("\n--- Testing shared heap ---\n");
+    char name[64];
+    snprintf(name, sizeof(name), "/memflex_test_%d", (int)getpid());
+    shm_unlink(name);
+
+    memflex_heap_t *heap = heap_shared_open(name, 64 * 1024, 0);
+    ASSERT_NOT_NULL(heap, "Shared heap should be created");
+
+    int fds[2];
+    ASSERT(pipe(fds) == 0, "Pipe for the offset should open");
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // Attach again so the region lands at a different address than the parent's
+        memflex_heap_t *child = heap_shared_open(name, 0, 0);
+        char *msg = child ? heap_malloc(child, 64, ALGO_FIRST_FIT) : NULL;
+        size_t offset = 0;
+        if (msg)
+        {
+            strcpy(msg, "zero-copy hello");
+            offset = heap_ptr_to_offset(child, msg);
+        }
+        write(fds[1], &offset, sizeof(offset));
+        _exit(0);
+    }
+
+    size_t offset = 0;
+    read(fds[0], &offset, sizeof(offset));
+    waitpid(pid, NULL, 0);
+    close(fds[0]);
+    close(fds[1]);
+
+    ASSERT(offset != 0, "Child should allocate from the shared heap");
+    char *msg = heap_offset_to_ptr(heap, offset);
+    ASSERT(strcmp(msg, "zero-copy hello") == 0, "Parent should read the child's data in place");
+
+    int blocks = heap_get_block_count(heap);
+    heap_free(heap, msg);
+    ASSERT(heap_get_block_count(heap) < blocks, "Parent should free a block the child allocated");
+    ASSERT(heap_halloc(heap, 16) == 0, "Shared heaps should refuse relocatable handles");
+
+    heap_destroy(heap);
+    shm_unlink(name);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/memflex_test_%d.heap", (int)getpid());
+    unlink(path);
+
+    heap = heap_shared_open(path, 16 * 1024, HEAP_SHARED_FILE);
+    ASSERT_NOT_NULL(heap, "File-backed heap should be created");
+    char *state = heap_malloc(heap, 32, ALGO_FIRST_FIT);
+    strcpy(state, "warm state");
+    offset = heap_ptr_to_offset(heap, state);
+    heap_destroy(heap);
+
+    heap = heap_shared_open(path, 0, HEAP_SHARED_FILE);
+    ASSERT_NOT_NULL(heap, "File-backed heap should reopen");
+    ASSERT(strcmp(heap_offset_to_ptr(heap, offset), "warm state") == 0, "Reopened heap should keep its data");
+    ASSERT(heap_get_block_count(heap) == 2, "Reopened heap should keep its block layout");
+    heap_destroy(heap);
+    unlink(path);
+}
+
+void test_growth_and_reserve()
+{
+    printf("\n--- Testing growth and reserve ---\n");
+    memflex_heap_t *heap = heap_create(HEAP_BACKING_MMAP, NULL, 4096);
+    ASSERT_NOT_NULL(heap, "mmap-backed heap should be created");
+
+    heap_set_growth(heap, 4096, 64 * 1024);
+    size_t before = heap_get_total_size(heap);
+    for (int i = 0; i < 64; i++)
+    {
+        ASSERT_NOT_NULL(heap_malloc(heap, 1000, ALGO_FIRST_FIT), "Allocation should succeed while growing");
+    }
+    size_t grown = heap_get_total_size(heap);
+    ASSERT(grown >= before + 64 * 1000, "Heap should grow to hold the allocations");
+    ASSERT(grown < 4 * 64 * 1000, "Geometric growth should not overshoot by more than the doubling");
+
+    ASSERT_EQ(heap_reserve(heap, 512 * 1024, 1), 0, "Reserve with prefault should succeed");
+    size_t reserved = heap_get_total_size(heap);
+    ASSERT(reserved > grown, "Reserve should grow the heap up front");
+    for (int i = 0; i < 400; i++)
+    {
+        heap_malloc(heap, 1000, ALGO_FIRST_FIT);
+    }
+    ASSERT_EQ(heap_get_total_size(heap), reserved, "Allocations should be served from the reservation");
+    heap_destroy(heap);
+
+    // A new mmap segment never merges with the old tail, so it must hold the whole request
+    heap = heap_create(HEAP_BACKING_MMAP, NULL, 4096);
+    ASSERT_EQ(heap_reserve(heap, 2 * 1024 * 1024, 0), 0, "Reserve across segments should succeed");
+    size_t largest = 0;
+    heap_get_free_bytes(heap, ALGO_FIRST_FIT, &largest);
+    ASSERT(largest >= 2 * 1024 * 1024, "Reserve should leave one free block of the requested size");
+    reserved = heap_get_total_size(heap);
+    ASSERT_NOT_NULL(heap_malloc(heap, 2 * 1024 * 1024, ALGO_FIRST_FIT), "Reserved allocation should succeed");
+    ASSERT_EQ(heap_get_total_size(heap), reserved, "Reserved allocation should not grow the heap");
+    heap_destroy(heap);
+
+    static char buffer[2048];
+    heap = heap_create(HEAP_BACKING_BUFFER, buffer, sizeof(buffer));
+    ASSERT_EQ(heap_reserve(heap, 1024, 1), 0, "Reserve inside a buffer should succeed if it fits");
+    ASSERT(heap_reserve(heap, 4096, 0) != 0, "Reserve beyond a buffer should fail");
+    heap_destroy(heap);
+
+    // Two separate 304-byte holes add up to 608 free bytes but cannot hold 600 in one block
+    static char holes[4096];
+    memflex_heap_t *fixed[2] = {
+        heap_create(HEAP_BACKING_BUFFER, holes, sizeof(holes)),
+        heap_create_ex(HEAP_BACKING_MMAP, NULL, 4096, HEAP_FLAG_OOB_META),
+    };
+    for (int h = 0; h < 2; h++)
+    {
+        void *a = heap_malloc(fixed[h], 304, ALGO_FIRST_FIT);
+        heap_malloc(fixed[h], 16, ALGO_FIRST_FIT);
+        void *b = heap_malloc(fixed[h], 304, ALGO_FIRST_FIT);
+        while (heap_malloc(fixed[h], 16, ALGO_FIRST_FIT))
+        {
+        }
+        heap_free(fixed[h], a);
+        heap_free(fixed[h], b);
+        ASSERT(heap_reserve(fixed[h], 600, 0) != 0, "Reserve should fail when no single free block fits");
+        ASSERT_EQ(heap_reserve(fixed[h], 300, 1), 0, "Reserve should succeed when one free block fits");
+        ASSERT_NOT_NULL(heap_malloc(fixed[h], 300, ALGO_FIRST_FIT), "A successful reserve should be allocatable");
+        heap_destroy(fixed[h]);
+    }
+}
+
+void test_oob_metadata()
+{
+    printf("\n--- Testing out-of-band metadata ---\n");
+    memflex_heap_t *heap = heap_create_ex(HEAP_BACKING_MMAP, NULL, 64 * 1024, HEAP_FLAG_OOB_META);
+    ASSERT_NOT_NULL(heap, "Metadata-separated heap should be created");
+
+    unsigned char *a = heap_malloc(heap, 40, ALGO_BEST_FIT);
+    unsigned char *b = heap_malloc(heap, 40, ALGO_BEST_FIT);
+    unsigned char *c = heap_malloc(heap, 40, ALGO_BEST_FIT);
+    ASSERT(a && b && c, "Allocations should succeed");
+    ASSERT_EQ(heap_get_block_count(heap), 4, "Three used blocks and a free tail");
+
+    // Scribble over a's slack and into b: only user data is hit, never allocator state
+    memset(a, 0xFF, 48 + 16);
+    heap_free(heap, b);
+    ASSERT_EQ(heap_get_block_count(heap), 4, "Freeing b should leave a hole");
+    heap_free(heap, a);
+    ASSERT_EQ(heap_get_block_count(heap), 3, "Freeing a should merge with the hole after it");
+
+    memset(c, 0x42, 40);
+    unsigned char *d = heap_realloc(heap, c, 4000);
+    ASSERT_NOT_NULL(d, "Growing realloc should succeed");
+    int preserved = 1;
+    for (int i = 0; i < 40; i++)
+    {
+        if (d[i] != 0x42)
+            preserved = 0;
+    }
+    ASSERT(preserved, "Data should be preserved after grow");
+
+    heap_free(heap, d);
+    ASSERT_EQ(heap_get_block_count(heap), 1, "Everything should coalesce back into one block");
+    ASSERT_NULL(heap_malloc(heap, 128 * 1024, ALGO_FIRST_FIT), "Metadata-separated heaps should not grow");
+    ASSERT(heap_halloc(heap, 16) == 0, "Metadata-separated heaps should refuse relocatable handles");
+    heap_destroy(heap);
+}
+
+/* Leave holes of 304, 104 and 200 bytes separated by live blocks, nothing else free */
+static void make_three_holes(memflex_heap_t *heap, void **h300, void **h100, void **h200)
+{
+    *h300 = heap_malloc(heap, 304, ALGO_FIRST_FIT);
+    heap_malloc(heap, 16, ALGO_FIRST_FIT);
+    *h100 = heap_malloc(heap, 104, ALGO_FIRST_FIT);
+    heap_malloc(heap, 16, ALGO_FIRST_FIT);
+    *h200 = heap_malloc(heap, 200, ALGO_FIRST_FIT);
+    while (heap_malloc(heap, 16, ALGO_FIRST_FIT))
+    {
+    }
+    heap_free(heap, *h300);
+    heap_free(heap, *h100);
+    heap_free(heap, *h200);
+}
+
+#define CHURN_SLOTS 256
+
+static int holds_byte(const unsigned char *p, size_t size, unsigned char value)
+{
+    for (size_t j = 0; j < size; j++)
+    {
+        if (p[j] != value)
+            return 0;
+    }
+    return 1;
+}
+
+/* Random mallocs (every 7th one first-fit), frees and reallocs, optionally a
+ * compaction pass, then a free of everything. Returns 0 if an allocation
+ * failed or a block lost its contents, which is what overlapping blocks do. */
+static int churn(memflex_heap_t *heap, alloc_algo_t algo, unsigned seed, size_t max_size, int compact)
+{
+    void *live[CHURN_SLOTS] = {0};
+    size_t sizes[CHURN_SLOTS] = {0};
+    srand(seed);
+    int ok = 1;
+    for (int round = 0; round < 20000 && ok; round++)
+    {
+        int i = rand() % CHURN_SLOTS;
+        if (live[i] && round % 5 == 0)
+        {
+            ok = holds_byte(live[i], sizes[i], (unsigned char)i);
+            sizes[i] = rand() % max_size + 1;
+            live[i] = heap_realloc(heap, live[i], sizes[i]);
+        }
+        else if (live[i])
+        {
+            ok = holds_byte(live[i], sizes[i], (unsigned char)i);
+            heap_free(heap, live[i]);
+            live[i] = NULL;
+            continue;
+        }
+        else
+        {
+            sizes[i] = rand() % max_size + 1;
+            live[i] = heap_malloc(heap, sizes[i], (round % 7) ? algo : ALGO_FIRST_FIT);
+        }
+
+        if (!live[i])
+            ok = 0;
+        else
+            memset(live[i], i, sizes[i]);
+    }
+
+    if (compact)
+    {
+        // Compaction slides handle blocks through the holes the churn left
+        memflex_handle_t handles[32];
+        for (int i = 0; i < 32; i++)
+        {
+            handles[i] = heap_halloc(heap, 100 + i);
+        }
+        for (int i = 0; i < 32; i += 2)
+        {
+            heap_hfree(heap, handles[i]);
+        }
+        heap_compact(heap, 0);
+        for (int i = 1; i < 32; i += 2)
+        {
+            heap_hfree(heap, handles[i]);
+        }
+    }
+
+    for (int i = 0; i < CHURN_SLOTS; i++)
+    {
+        if (live[i] && !holds_byte(live[i], sizes[i], (unsigned char)i))
+            ok = 0;
+        heap_free(heap, live[i]);
+    }
+    return ok;
+}
+
+static int churn_check(memflex_heap_t *heap, alloc_algo_t algo, unsigned seed, size_t max_size)
+{
+    return churn(heap, algo, seed, max_size, 0);
+}
+
+/* churn_check with handle blocks compacted while the churned blocks are live */
+static int churn_compact_check(memflex_heap_t *heap, alloc_algo_t algo, unsigned seed, size_t max_size)
+{
+    return churn(heap, algo, seed, max_size, 1);
+}
+
+void test_free_index()
+{
+    printf("\n--- Testing free-size index ---\n");
+    static char buffer[8192];
+    memflex_heap_t *heap = heap_create_ex(HEAP_BACKING_BUFFER, buffer, sizeof(buffer), HEAP_FLAG_FREE_INDEX);
+    ASSERT_NOT_NULL(heap, "Indexed heap should be created");
+
+    void *h300, *h100, *h200;
+    make_three_holes(heap, &h300, &h100, &h200);
+
+    ASSERT(heap_malloc(heap, 150, ALGO_BEST_FIT) == h200, "Best fit should pick the 200-byte hole");
+    ASSERT(heap_malloc(heap, 50, ALGO_WORST_FIT) == h300, "Worst fit should pick the 300-byte hole");
+    ASSERT(heap_malloc(heap, 104, ALGO_BEST_FIT) == h100, "Best fit should take an exact match");
+    heap_destroy(heap);
+
+    // Random churn (with compaction moving blocks under the index) must never hand out overlapping memory
+    heap = heap_create_ex(HEAP_BACKING_MMAP, NULL, 4096, HEAP_FLAG_FREE_INDEX);
+    ASSERT(churn_check(heap, ALGO_BEST_FIT, 42, 700), "Indexed best-fit allocations should never overlap");
+    ASSERT(churn_compact_check(heap, ALGO_WORST_FIT, 43, 700), "Indexed worst-fit allocations should never overlap");
+    ASSERT_NOT_NULL(heap_malloc(heap, 64, ALGO_BEST_FIT), "Index should stay usable after compaction");
+    heap_destroy(heap);
+}
+
+void test_tlsf()
+{
+    printf("\n--- Testing TLSF ---\n");
+    static char buffer[8192];
+    memflex_heap_t *heap = heap_create(HEAP_BACKING_BUFFER, buffer, sizeof(buffer));
+
+    void *h300, *h100, *h200;
+    make_three_holes(heap, &h300, &h100, &h200);
+
+    // The lists are built from the existing free blocks on first use
+    ASSERT(heap_malloc(heap, 150, ALGO_TLSF) == h200, "TLSF should pick the smallest class that fits");
+    ASSERT(heap_malloc(heap, 104, ALGO_TLSF) == h100, "TLSF should take an exact class");
+    ASSERT(heap_malloc(heap, 400, ALGO_TLSF) == NULL, "TLSF should fail when no class fits");
+
+    // Freed neighbours merge at once and the merged block is findable
+    heap_free(heap, h200);
+    heap_free(heap, h100);
+    ASSERT_NOT_NULL(heap_malloc(heap, 304, ALGO_TLSF), "TLSF should reuse a hole after a free");
+    heap_destroy(heap);
+
+    // A heap with the free-size index keeps it and answers TLSF requests with best-fit
+    heap = heap_create_ex(HEAP_BACKING_BUFFER, buffer, sizeof(buffer), HEAP_FLAG_FREE_INDEX);
+    make_three_holes(heap, &h300, &h100, &h200);
+    ASSERT(heap_malloc(heap, 150, ALGO_TLSF) == h200, "TLSF on an indexed heap should fall back to best-fit");
+    ASSERT(heap_malloc(heap, 50, ALGO_WORST_FIT) == h300, "The free-size index should still serve worst-fit");
+    heap_destroy(heap);
+
+    // Prefaulting a reservation must not clobber the links kept in free payloads
+    heap = heap_create(HEAP_BACKING_BUFFER, buffer, sizeof(buffer));
+    heap_free(heap, heap_malloc(heap, 16, ALGO_TLSF));
+    void *a = heap_malloc(heap, 104, ALGO_TLSF);
+    heap_malloc(heap, 16, ALGO_TLSF);
+    void *b = heap_malloc(heap, 104, ALGO_TLSF);
+    heap_malloc(heap, 16, ALGO_TLSF);
+    heap_free(heap, a);
+    heap_free(heap, b);
+    ASSERT_EQ(heap_reserve(heap, 16, 1), 0, "Reserve with prefault should succeed on a TLSF heap");
+    void *c = heap_malloc(heap, 104, ALGO_TLSF);
+    void *d = heap_malloc(heap, 104, ALGO_TLSF);
+    ASSERT((c == a && d == b) || (c == b && d == a), "TLSF lists should survive a prefaulting reserve");
+    heap_destroy(heap);
+
+    heap = heap_create(HEAP_BACKING_MMAP, NULL, 4096);
+    heap_free(heap, heap_malloc(heap, 16, ALGO_TLSF));
+    ASSERT_EQ(heap_reserve(heap, 64 * 1024, 1), 0, "Reserve with prefault should grow a TLSF heap");
+    ASSERT(churn_check(heap, ALGO_TLSF, 11, 2000), "TLSF churn after a prefaulting reserve should stay consistent");
+    heap_destroy(heap);
+
+    // Churn mixing TLSF, first-fit, realloc and compaction must keep the lists consistent
+    heap = heap_create(HEAP_BACKING_MMAP, NULL, 4096);
+    ASSERT(churn_compact_check(heap, ALGO_TLSF, 7, 2000), "TLSF allocations should never overlap");
+    ASSERT_NOT_NULL(heap_malloc(heap, 64, ALGO_TLSF), "TLSF should stay usable after compaction");
+    ASSERT_NOT_NULL(heap_malloc(heap, 64, ALGO_BEST_FIT), "Best fit should still work beside the TLSF lists");
+    heap_destroy(heap);
+}
+
+void test_buddy()
+{
+    printf("\n--- Testing buddy allocator ---\n");
+    memflex_heap_t *heap = heap_create(HEAP_BACKING_MMAP, NULL, 64 * 1024);
+    ASSERT_EQ(heap_set_buddy(heap, 14, 5), 0, "16 KB region with 32-byte blocks should be accepted");
+    ASSERT_EQ(heap_set_buddy(heap, 14, 3), -1, "Blocks smaller than the free-list links should be rejected");
+
+    char *a = heap_malloc(heap, 100, ALGO_BUDDY);
+    char *b = heap_malloc(heap, 100, ALGO_BUDDY);
+    ASSERT_NOT_NULL(a, "Buddy allocation should succeed");
+    ASSERT_EQ(heap_usable_size(heap, a), 128, "Requests round up to a power of two");
+    ASSERT(b == a + 128, "The second block should be the first one's buddy");
+    ASSERT_EQ(heap_usable_size(heap, heap_malloc(heap, 1, ALGO_BUDDY)), 32, "The minimum order bounds small requests");
+    ASSERT_EQ(heap_set_buddy(heap, 15, 5), -1, "Configuration is fixed once the region exists");
+
+    // Freeing both buddies merges them; the region is whole again after the small block goes too
+    char *small = a + 256;
+    heap_free(heap, a);
+    heap_free(heap, b);
+    heap_free(heap, small);
+    size_t largest;
+    ASSERT_EQ(heap_get_free_bytes(heap, ALGO_BUDDY, &largest), 16384, "All buddy bytes should be free");
+    ASSERT_EQ(largest, 16384, "Buddies should merge back into the whole region");
+    ASSERT(heap_malloc(heap, 16384, ALGO_BUDDY) == a, "The whole region should be allocatable");
+    char *spill = heap_malloc(heap, 1, ALGO_BUDDY);
+    ASSERT(spill != NULL && (spill < a || spill >= a + 16384), "An exhausted region should fall back to the block list");
+    heap_free(heap, spill);
+    heap_free(heap, a);
+    char *huge = heap_malloc(heap, 64 * 1024, ALGO_BUDDY);
+    ASSERT(huge != NULL && (huge < a || huge >= a + 16384), "Requests bigger than the region should use the block list");
+    heap_free(heap, huge);
+
+    // realloc stays inside the region and keeps the data
+    char *r = heap_malloc(heap, 40, ALGO_BUDDY);
+    memset(r, 7, 40);
+    ASSERT(heap_realloc(heap, r, 64) == r, "Growing within the block should stay in place");
+    r = heap_realloc(heap, r, 1000);
+    ASSERT(r != NULL && r[39] == 7 && heap_usable_size(heap, r) == 1024, "Growing past the block should move to a bigger one");
+    r = heap_realloc(heap, r, 32 * 1024);
+    ASSERT(r != NULL && r[39] == 7 && (r < a || r >= a + 16384), "Growing past the region should move out of it");
+    heap_free(heap, r);
+
+    // Random churn must never hand out overlapping blocks and must merge back completely. Blocks
+    // of at most 64 bytes keep the ~128 live ones inside the region rather than on the block list
+    ASSERT(churn_check(heap, ALGO_BUDDY, 3, 64), "Buddy allocations should never overlap");
+    heap_get_free_bytes(heap, ALGO_BUDDY, &largest);
+    ASSERT_EQ(largest, 16384, "Churn should merge back into the whole region");
+
+    // The list allocator keeps working around the region
+    void *plain = heap_malloc(heap, 200, ALGO_FIRST_FIT);
+    ASSERT_NOT_NULL(plain, "First-fit should still allocate beside the buddy region");
+    heap_free(heap, plain);
+    heap_destroy(heap);
+
+    // The default heap through my_malloc/my_free
+    void *p = my_malloc(500, ALGO_BUDDY);
+    ASSERT_NOT_NULL(p, "my_malloc should serve ALGO_BUDDY");
+    my_free(p);
+    p = my_malloc(2 * 1024 * 1024, ALGO_BUDDY);
+    ASSERT_NOT_NULL(p, "my_malloc should serve ALGO_BUDDY requests bigger than the region");
+    my_free(p);
+}
+
+/* Read the totals line of a pprof heap profile, sampling period last */
+static int read_profile_totals(const char *path, unsigned long long totals[5])
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    int n = fscanf(fp, "heap profile: %llu: %llu [%llu: %llu] @ heap_v2/%llu",
+                   &totals[0], &totals[1], &totals[2], &totals[3], &totals[4]);
+    fclose(fp);
+    return n == 5 ? 0 : -1;
+}
+
+void test_heap_profile()
+{
+    printf("\n--- Testing heap profiler ---\n");
+    memflex_heap_t *heap = heap_create(HEAP_BACKING_MMAP, NULL, 64 * 1024);
+    const char *path = "/tmp/memflex_test_profile";
+    unsigned long long totals[5];
+
+    // A one-byte interval samples every allocation
+    heap_profile_start(1);
+    void *a = heap_malloc(heap, 100, ALGO_FIRST_FIT);
+    void *b = heap_malloc(heap, 200, ALGO_FIRST_FIT);
+    void *c = heap_malloc(heap, 300, ALGO_FIRST_FIT);
+    heap_free(heap, b);
+    c = heap_realloc(heap, c, 400);
+
+    // A sampled handle block moved by compaction is still retired by hfree
+    memflex_handle_t h1 = heap_halloc(heap, 64);
+    memflex_handle_t h2 = heap_halloc(heap, 64);
+    heap_hfree(heap, h1);
+    heap_compact(heap, 0);
+    heap_hfree(heap, h2);
+    heap_profile_stop();
+
+    ASSERT_EQ(heap_profile_dump(path, HEAP_PROFILE_PPROF), 0, "pprof dump should be written");
+    ASSERT_EQ(read_profile_totals(path, totals), 0, "pprof header should parse");
+    ASSERT(totals[0] == 2 && totals[1] == 500, "Live samples should be the 100 and 400 byte blocks");
+    ASSERT(totals[2] == 6 && totals[3] == 1128, "Cumulative samples should include freed blocks");
+    ASSERT_EQ(totals[4], 1, "Dump after stop should keep the session's sampling period");
+
+    ASSERT_EQ(heap_profile_dump(path, HEAP_PROFILE_FOLDED_LIVE), 0, "Folded dump should be written");
+    FILE *fp = fopen(path, "r");
+    char line[4096];
+    unsigned long long sum = 0;
+    int lines = 0;
+    while (fp && fgets(line, sizeof(line), fp))
+    {
+        sum += strtoull(strrchr(line, ' ') + 1, NULL, 10);
+        lines++;
+    }
+    if (fp)
+        fclose(fp);
+    ASSERT(lines == 2 && sum == 500, "Folded stacks should list live bytes per call site");
+
+    // Nothing is sampled once stopped, but frees still retire samples
+    void *d = heap_malloc(heap, 64, ALGO_FIRST_FIT);
+    heap_free(heap, a);
+    heap_free(heap, c);
+    heap_free(heap, d);
+    heap_profile_dump(path, HEAP_PROFILE_PPROF);
+    read_profile_totals(path, totals);
+    ASSERT(totals[0] == 0 && totals[1] == 0 && totals[2] == 6, "Frees after stop should empty the live set");
+
+    heap_destroy(heap);
+
+    // A realloc that cannot grow leaves the block, and its sample, where they were
+    static char buffer[4096];
+    heap = heap_create(HEAP_BACKING_BUFFER, buffer, sizeof(buffer));
+    heap_profile_start(1);
+    a = heap_malloc(heap, 100, ALGO_FIRST_FIT);
+    ASSERT_NULL(heap_realloc(heap, a, 100000), "Realloc past the buffer should fail");
+    heap_profile_stop();
+    heap_profile_dump(path, HEAP_PROFILE_PPROF);
+    read_profile_totals(path, totals);
+    ASSERT(totals[0] == 1 && totals[1] == 100, "Failed realloc should keep the old block sampled");
+    heap_free(heap, a);
+    heap_destroy(heap);
+
+    // Destroying a heap retires its samples; a later heap at the same addresses starts clean
+    heap_profile_start(1);
+    heap = heap_create(HEAP_BACKING_MMAP, NULL, 4096);
+    for (int i = 0; i < 10; i++)
+    {
+        heap_malloc(heap, 1000, ALGO_FIRST_FIT);
+    }
+    heap_destroy(heap);
+    for (int i = 0; i < 10; i++)
+    {
+        my_malloc(1000, ALGO_FIRST_FIT);
+    }
+    my_memory_reset();
+    heap_profile_stop();
+    heap_profile_dump(path, HEAP_PROFILE_PPROF);
+    read_profile_totals(path, totals);
+    ASSERT(totals[0] == 0 && totals[1] == 0 && totals[2] == 20, "Destroy and reset should retire the heap's samples");
+
+    // A restart with a shorter interval applies from the next allocation, not once the old countdown runs out
+    heap = heap_create(HEAP_BACKING_MMAP, NULL, 4096);
+    heap_profile_start(1 << 30);
+    heap_free(heap, heap_malloc(heap, 64, ALGO_FIRST_FIT));
+    heap_profile_start(1);
+    a = heap_malloc(heap, 64, ALGO_FIRST_FIT);
+    heap_profile_stop();
+    heap_profile_dump(path, HEAP_PROFILE_PPROF);
+    read_profile_totals(path, totals);
+    ASSERT(totals[0] == 1 && totals[4] == 1, "A restarted session should sample at its own interval at once");
+    heap_destroy(heap);
+
+    unlink(path);
+}
+
 int main()
 {
     printf("Initializing Test Suite...\n");
@@ -121,6 +760,15 @@ int main()
     test_free();
     test_calloc();
     test_realloc();
+    test_heap_instances();
+    test_compaction();
+    test_shared_heap();
+    test_growth_and_reserve();
+    test_oob_metadata();
+    test_free_index();
+    test_tlsf();
+    test_buddy();
+    test_heap_profile();
 
     printf("\nAll Tests Passed Successfully!\n");
     return 0;
@@ -21,4 +21,21 @@ pub struct BenchmarkResult {
     pub name: String,
     pub time: f64,
     pub total_blocks: u64,
+    /// Hardware cache misses per Step 3 malloc; negative when perf counters were unavailable
+    #[serde(default = "missing_counter")]
+    pub cache_misses_per_malloc: f64,
+    /// Slowest and 99.9th-percentile malloc of the run, in nanoseconds
+    #[serde(default)]
+    pub max_latency_ns: u64,
+    #[serde(default)]
+    pub p999_latency_ns: u64,
+    /// Share of live block bytes lost to rounding, and of free bytes outside the largest free block
+    #[serde(default)]
+    pub internal_frag: f64,
+    #[serde(default)]
+    pub external_frag: f64,
+}
+
+fn missing_counter() -> f64 {
+    -1.0
 }
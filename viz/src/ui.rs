@@ -292,7 +292,7 @@ fn render_global_stats(frame: &mut Frame, app: &App, area: Rect) {
     let chunks = Layout::default()
         .direction(Direction::Vertical)
         .constraints([
-            Constraint::Length(6), // Table
+            Constraint::Length(app.benchmark_results.len() as u16 + 3), // Table
             Constraint::Min(1),    // Charts
         ])
         .split(area);
@@ -350,9 +350,17 @@ fn render_global_stats(frame: &mut Frame, app: &App, area: Rect) {
 }
 
 fn render_benchmark_table(frame: &mut Frame, app: &App, area: Rect) {
-    let header_cells = ["Algo", "Step 3 Time (s)", "Blocks"]
-        .iter()
-        .map(|h| Cell::from(*h).style(Style::default().fg(TOKYO_BG).bg(TOKYO_BLUE)));
+    let header_cells = [
+        "Algo",
+        "Step 3 Time (s)",
+        "Blocks",
+        "Misses/malloc",
+        "Max (ns)",
+        "p99.9 (ns)",
+        "Frag int/ext",
+    ]
+    .iter()
+    .map(|h| Cell::from(*h).style(Style::default().fg(TOKYO_BG).bg(TOKYO_BLUE)));
     let header = Row::new(header_cells)
         .style(Style::default().bg(TOKYO_BLUE))
         .height(1);
@@ -362,6 +370,18 @@ fn render_benchmark_table(frame: &mut Frame, app: &App, area: Rect) {
             Cell::from(item.name.clone()),
             Cell::from(format!("{:.6}", item.time)),
             Cell::from(item.total_blocks.to_string()),
+            Cell::from(if item.cache_misses_per_malloc < 0.0 {
+                "n/a".to_string()
+            } else {
+                format!("{:.2}", item.cache_misses_per_malloc)
+            }),
+            Cell::from(item.max_latency_ns.to_string()),
+            Cell::from(item.p999_latency_ns.to_string()),
+            Cell::from(format!(
+                "{:.1}% / {:.1}%",
+                item.internal_frag * 100.0,
+                item.external_frag * 100.0
+            )),
         ];
         Row::new(cells)
             .height(1)
@@ -371,9 +391,13 @@ fn render_benchmark_table(frame: &mut Frame, app: &App, area: Rect) {
     let t = Table::new(
         rows,
         [
-            Constraint::Percentage(30),
-            Constraint::Percentage(40),
-            Constraint::Percentage(30),
+            Constraint::Percentage(16),
+            Constraint::Percentage(15),
+            Constraint::Percentage(9),
+            Constraint::Percentage(13),
+            Constraint::Percentage(12),
+            Constraint::Percentage(12),
+            Constraint::Percentage(23),
         ],
     )
     .header(header)